@@ -1,5 +1,5 @@
 #!/bin/bash
 FLAGS="-Wall -Wextra -Werror"
-RAYLIB="-I./raylib/include -L./raylib/lib -l:libraylib.a -lm"
-FILES="src/main.c src/player.c"
+RAYLIB="-I./raylib/include -L./raylib/lib -l:libraylib.a -lm -lpthread"
+FILES="src/main.c src/player.c src/loader.c src/audio.c src/decoder.c src/mixer.c src/seek.c src/mp3.c src/library.c src/watcher.c src/snapshot.c src/pool.c src/text.c src/search.c src/fuzzy.c src/collate.c src/browser.c src/covers.c src/thumbcache.c src/coverstore.c src/tags.c src/exiftool.c"
 gcc $FLAGS -o main $FILES $RAYLIB
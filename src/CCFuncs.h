@@ -43,6 +43,8 @@
 // printf like function that prints the name and line of the file where it was called
 #define log_error(msg, ...) _log_error(msg, __FILE__, __LINE__, __VA_ARGS__);
 
+void _log_error(const char *msg, char *file, int line, ...);
+
 typedef struct {
     char *items;
     size_t count;
@@ -52,6 +54,12 @@ typedef struct {
 // dumps a null terminated string
 char *sb_dump_str(StringBuilder *sb);
 
+// appends the utf-8 encoding of the codepoint
+void sb_append_utf8(StringBuilder *sb, unsigned int codepoint);
+
+// returns a buffer allocated with malloc, invalid characters are skipped
+unsigned char *base64_decode(const unsigned char *data, size_t size, size_t *decodedSize);
+
 #endif // CCFUNCS_H
 
 #ifdef CCFUNCS_IMPLEMENTATION
@@ -74,4 +82,49 @@ char *sb_dump_str(StringBuilder *sb) {
     return str;
 }
 
+void sb_append_utf8(StringBuilder *sb, unsigned int codepoint) {
+    if(codepoint < 0x80) {
+        da_append(sb, (char)codepoint);
+    } else if(codepoint < 0x800) {
+        da_append(sb, (char)(0xC0 | codepoint >> 6));
+        da_append(sb, (char)(0x80 | (codepoint & 0x3F)));
+    } else if(codepoint < 0x10000) {
+        da_append(sb, (char)(0xE0 | codepoint >> 12));
+        da_append(sb, (char)(0x80 | (codepoint >> 6 & 0x3F)));
+        da_append(sb, (char)(0x80 | (codepoint & 0x3F)));
+    } else {
+        da_append(sb, (char)(0xF0 | codepoint >> 18));
+        da_append(sb, (char)(0x80 | (codepoint >> 12 & 0x3F)));
+        da_append(sb, (char)(0x80 | (codepoint >> 6 & 0x3F)));
+        da_append(sb, (char)(0x80 | (codepoint & 0x3F)));
+    }
+}
+
+static const char base64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+unsigned char *base64_decode(const unsigned char *data, size_t size, size_t *decodedSize) {
+    unsigned char *decoded = malloc(size / 4 * 3 + 3);
+    if(decoded == NULL) return NULL;
+
+    unsigned int bits = 0;
+    int bitsCount = 0;
+    size_t count = 0;
+
+    for(size_t i = 0; i < size && data[i] != '='; i++) {
+        const char *c = memchr(base64Alphabet, data[i], sizeof(base64Alphabet) - 1);
+        if(c == NULL) continue;
+
+        bits = bits << 6 | (unsigned int)(c - base64Alphabet);
+        bitsCount += 6;
+
+        if(bitsCount >= 8) {
+            bitsCount -= 8;
+            decoded[count++] = bits >> bitsCount & 0xFF;
+        }
+    }
+
+    *decodedSize = count;
+    return decoded;
+}
+
 #endif // CCFUNCS_IMPLEMENTATION
@@ -0,0 +1,477 @@
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "CCFuncs.h"
+#include "audio.h"
+#include "decoder.h"
+#include "mixer.h"
+
+// how often the thread refills the ring, much shorter than the time the ring lasts
+#define AUDIO_FEEDER_INTERVAL_US 5000
+// minimum time between two real seeks, the requests that arrive in between only replace the target
+#define AUDIO_SEEK_INTERVAL 0.15
+// decoded frames waiting for the stream, about 370ms at 44.1kHz
+#define AUDIO_RING_FRAMES 16384
+// frames decoded at once by the thread
+#define AUDIO_DECODE_FRAMES 1024
+
+// a track in the ring, it's heard from the frame `start` of the output
+typedef struct {
+    MusicTrack *track;
+    uint64_t start;
+    uint64_t position; // frame of the track at `start`
+} AudioSegment;
+
+static struct {
+    pthread_t thread;
+    // protects the tracks and their decoders, the thread holds it to decode a chunk or to seek so the main
+    // thread only waits for it when the tracks change, never for the calls made every frame
+    pthread_mutex_t lock;
+    bool running;
+    bool quit;
+
+    AudioStream stream; // stereo floats at the sample rate of the current track, only used by the main thread
+    bool playing;
+
+    MusicTrack *current; // track being decoded
+    MusicTrack *next; // continues the current one when it ends
+    uint64_t fadeLength; // frames of the crossfade in progress, the next track is decoded along the current one
+    double lastSeek;
+
+    // the settings and requests of the main thread, the thread only holds it to copy them
+    pthread_mutex_t requestLock;
+    float crossfade; // seconds, 0 splices the tracks
+    // only the latest requested seek is kept until the decoder is free to apply it
+    bool seekPending;
+    bool seekFlush; // apply it without waiting for the interval
+    float seekTarget;
+    unsigned long seekRequest; // counts the requests, the pending one is only cleared if none came meanwhile
+
+    // written by the thread and read by the stream callback in the audio device thread, the callback only
+    // waits for this lock so decoding never blocks it
+    pthread_mutex_t ringLock;
+    float ring[AUDIO_RING_FRAMES * DECODER_CHANNELS];
+    uint64_t written; // frames of the output since the start
+    uint64_t read;
+    bool finished; // there's no current track or it was decoded to its end without a next one to splice
+
+    struct {
+        AudioSegment *items; // tracks in the ring in order, the first one is heard or the previous was
+        size_t count;
+        size_t capacity;
+    } segments;
+} audio = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .requestLock = PTHREAD_MUTEX_INITIALIZER,
+    .ringLock = PTHREAD_MUTEX_INITIALIZER,
+    .finished = true,
+};
+
+static double get_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// called by raylib in the audio device thread when the stream needs frames, silence when the ring is empty
+static void audio_stream_callback(void *bufferData, unsigned int frames) {
+    float *out = bufferData;
+
+    pthread_mutex_lock(&audio.ringLock);
+
+    uint64_t available = audio.written - audio.read;
+    unsigned int count = available < frames ? available : frames;
+
+    for(unsigned int i = 0; i < count;) {
+        size_t index = (audio.read + i) % AUDIO_RING_FRAMES;
+        unsigned int chunk = AUDIO_RING_FRAMES - index;
+        if(chunk > count - i) chunk = count - i;
+
+        memcpy(out + i * DECODER_CHANNELS, audio.ring + index * DECODER_CHANNELS, chunk * DECODER_CHANNELS * sizeof(float));
+        i += chunk;
+    }
+
+    audio.read += count;
+    pthread_mutex_unlock(&audio.ringLock);
+
+    memset(out + count * DECODER_CHANNELS, 0, (frames - count) * DECODER_CHANNELS * sizeof(float));
+}
+
+// the ring lock has to be held, it has to have room for the frames
+static void write_ring(const float *frames, unsigned int count) {
+    for(unsigned int i = 0; i < count;) {
+        size_t index = (audio.written + i) % AUDIO_RING_FRAMES;
+        unsigned int chunk = AUDIO_RING_FRAMES - index;
+        if(chunk > count - i) chunk = count - i;
+
+        memcpy(audio.ring + index * DECODER_CHANNELS, frames + i * DECODER_CHANNELS, chunk * DECODER_CHANNELS * sizeof(float));
+        i += chunk;
+    }
+
+    audio.written += count;
+}
+
+// the segment being heard, the ones before it are dropped, the ring lock has to be held
+static AudioSegment *get_heard_segment(void) {
+    size_t heard = 0;
+    while(heard + 1 < audio.segments.count && audio.segments.items[heard + 1].start <= audio.read) heard++;
+
+    if(heard > 0) {
+        audio.segments.count -= heard;
+        memmove(audio.segments.items, audio.segments.items + heard, audio.segments.count * sizeof(AudioSegment));
+    }
+
+    return audio.segments.count == 0 ? NULL : &audio.segments.items[0];
+}
+
+// drops everything decoded that wasn't heard and starts the track at its position, both locks have to be held
+static void restart_ring(MusicTrack *track) {
+    audio.written = audio.read;
+    audio.finished = track == NULL;
+    audio.segments.count = 0;
+    if(track != NULL) da_append(&audio.segments, ((AudioSegment){track, audio.written, track->position}));
+}
+
+static bool can_splice(MusicTrack *track) {
+    return track != NULL && track->music.stream.sampleRate == audio.current->music.stream.sampleRate;
+}
+
+// the frames of the current track mixed with the next one, 0 without a next one to splice
+static uint64_t get_fade_frames(void) {
+    pthread_mutex_lock(&audio.requestLock);
+    float crossfade = audio.crossfade;
+    pthread_mutex_unlock(&audio.requestLock);
+
+    if(crossfade <= 0 || !can_splice(audio.next)) return 0;
+
+    uint64_t frames = crossfade * audio.current->music.stream.sampleRate;
+    return frames < audio.next->frameCount ? frames : audio.next->frameCount;
+}
+
+// the next track goes back to its start, the lock has to be held
+static void cancel_fade(void) {
+    if(audio.fadeLength > 0 && audio.next != NULL) seek_track_frame(audio.next, 0);
+    audio.fadeLength = 0;
+}
+
+// the lock has to be held
+static void apply_pending_seek(void) {
+    double now = get_seconds();
+
+    pthread_mutex_lock(&audio.requestLock);
+    bool ready = audio.seekPending && (audio.seekFlush || now - audio.lastSeek >= AUDIO_SEEK_INTERVAL);
+    float target = audio.seekTarget;
+    unsigned long request = audio.seekRequest;
+    pthread_mutex_unlock(&audio.requestLock);
+
+    if(!ready || audio.current == NULL) return;
+
+    pthread_mutex_lock(&audio.ringLock);
+
+    // the seek is in the track being heard, the next one goes back to its start if it was spliced already
+    AudioSegment *heard = get_heard_segment();
+    MusicTrack *track = heard == NULL ? audio.current : heard->track;
+
+    if(track != audio.current) {
+        cancel_fade();
+        seek_track_frame(audio.current, 0);
+        audio.next = audio.current;
+        audio.current = track;
+    }
+
+    cancel_fade();
+
+    pthread_mutex_unlock(&audio.ringLock);
+
+    // the main thread keeps showing the target until the ring restarts from it
+    seek_track_frame(track, target * track->music.stream.sampleRate);
+
+    pthread_mutex_lock(&audio.ringLock);
+    restart_ring(track);
+    pthread_mutex_unlock(&audio.ringLock);
+
+    pthread_mutex_lock(&audio.requestLock);
+    if(audio.seekRequest == request) {
+        audio.seekPending = false;
+        audio.seekFlush = false;
+    }
+    pthread_mutex_unlock(&audio.requestLock);
+
+    audio.lastSeek = now;
+}
+
+// decodes `count` frames of the current track, the last ones are mixed with the start of the next track
+static unsigned int decode_frames(float *frames, unsigned int count) {
+    uint64_t left = audio.current->frameCount - audio.current->position;
+    uint64_t fade = get_fade_frames();
+
+    // the fade starts at its exact frame, it's shorter when the next track was loaded late
+    if(audio.fadeLength == 0 && fade > 0 && left <= fade) audio.fadeLength = left;
+    if(audio.fadeLength == 0 && fade > 0 && left - fade < count) count = left - fade;
+
+    count = read_track_frames(audio.current, frames, count);
+    if(audio.fadeLength == 0 || count == 0) return count;
+
+    float nextFrames[AUDIO_DECODE_FRAMES * DECODER_CHANNELS];
+    unsigned int nextCount = read_track_frames(audio.next, nextFrames, count);
+    memset(nextFrames + nextCount * DECODER_CHANNELS, 0, (count - nextCount) * DECODER_CHANNELS * sizeof(float));
+
+    mix_crossfade(frames, nextFrames, count, audio.fadeLength - left, audio.fadeLength);
+    return count;
+}
+
+// decodes a chunk into the ring, returns false when the ring is full or there's nothing left to decode
+// the lock has to be held
+static bool fill_ring_chunk(void) {
+    if(audio.current == NULL) return false;
+
+    pthread_mutex_lock(&audio.ringLock);
+    bool full = AUDIO_RING_FRAMES - (audio.written - audio.read) < AUDIO_DECODE_FRAMES;
+    pthread_mutex_unlock(&audio.ringLock);
+
+    if(full) return false;
+
+    float frames[AUDIO_DECODE_FRAMES * DECODER_CHANNELS];
+    unsigned int count = decode_frames(frames, AUDIO_DECODE_FRAMES);
+    bool ended = count == 0 || audio.current->position >= audio.current->frameCount;
+
+    pthread_mutex_lock(&audio.ringLock);
+    write_ring(frames, count);
+
+    // the next track continues from the frame right after the last one of the current track, that's
+    // past its start after a crossfade
+    bool splice = ended && can_splice(audio.next);
+    if(splice) {
+        da_append(&audio.segments, ((AudioSegment){audio.next, audio.written, audio.next->position}));
+        audio.current = audio.next;
+        audio.next = NULL;
+        audio.fadeLength = 0;
+    }
+
+    audio.finished = ended && !splice;
+    pthread_mutex_unlock(&audio.ringLock);
+
+    return !audio.finished;
+}
+
+// the lock is released after every chunk so a change of track waits for one chunk at most
+static void *audio_feeder(void *arg) {
+    (void)arg;
+
+    while(true) {
+        pthread_mutex_lock(&audio.lock);
+
+        if(audio.quit) {
+            pthread_mutex_unlock(&audio.lock);
+            break;
+        }
+
+        apply_pending_seek();
+        bool more = fill_ring_chunk();
+
+        pthread_mutex_unlock(&audio.lock);
+
+        if(!more) usleep(AUDIO_FEEDER_INTERVAL_US);
+    }
+
+    return NULL;
+}
+
+void audio_init(void) {
+    audio.quit = false;
+
+    if(pthread_create(&audio.thread, NULL, audio_feeder, NULL) != 0) {
+        log_error("Failed to start the audio thread (%s)", "pthread_create");
+        return;
+    }
+
+    audio.running = true;
+}
+
+void audio_close(void) {
+    if(audio.running) {
+        pthread_mutex_lock(&audio.lock);
+        audio.quit = true;
+        pthread_mutex_unlock(&audio.lock);
+
+        pthread_join(audio.thread, NULL);
+        audio.running = false;
+    }
+
+    if(IsAudioStreamValid(audio.stream)) UnloadAudioStream(audio.stream);
+    audio.stream = (AudioStream){0};
+
+    audio.current = NULL;
+    audio.next = NULL;
+    da_free(&audio.segments);
+    memset(&audio.segments, 0, sizeof(audio.segments));
+}
+
+// a stream plays at one sample rate, raylib converts it to the one of the device
+static void create_stream(unsigned int sampleRate) {
+    if(IsAudioStreamValid(audio.stream)) UnloadAudioStream(audio.stream);
+
+    audio.stream = LoadAudioStream(sampleRate, 32, DECODER_CHANNELS);
+    if(!IsAudioStreamValid(audio.stream)) {
+        log_error("Failed to create an audio stream at %u Hz", sampleRate);
+        return;
+    }
+
+    SetAudioStreamCallback(audio.stream, audio_stream_callback);
+    if(audio.playing) PlayAudioStream(audio.stream);
+}
+
+void audio_set_track(MusicTrack *track) {
+    pthread_mutex_lock(&audio.lock);
+
+    if(track != NULL && track->position != 0) seek_track_frame(track, 0);
+    audio.current = track;
+    audio.next = NULL;
+    audio.fadeLength = 0;
+
+    pthread_mutex_lock(&audio.requestLock);
+    audio.seekPending = false;
+    audio.seekFlush = false;
+    pthread_mutex_unlock(&audio.requestLock);
+
+    pthread_mutex_lock(&audio.ringLock);
+    restart_ring(track);
+    pthread_mutex_unlock(&audio.ringLock);
+
+    pthread_mutex_unlock(&audio.lock);
+
+    // the callback can't be waiting for the ring lock while raylib replaces the stream
+    if(track != NULL && track->music.stream.sampleRate != audio.stream.sampleRate) {
+        create_stream(track->music.stream.sampleRate);
+    }
+}
+
+void audio_set_next(MusicTrack *track) {
+    pthread_mutex_lock(&audio.lock);
+    if(track != audio.current && track != audio.next) {
+        cancel_fade();
+        audio.next = track;
+
+        // the thread checks again if the current track can be continued
+        pthread_mutex_lock(&audio.ringLock);
+        audio.finished = audio.current == NULL;
+        pthread_mutex_unlock(&audio.ringLock);
+    }
+    pthread_mutex_unlock(&audio.lock);
+}
+
+void audio_set_crossfade(float seconds) {
+    if(seconds < 0) seconds = 0;
+    else if(seconds > MIXER_MAX_CROSSFADE) seconds = MIXER_MAX_CROSSFADE;
+
+    pthread_mutex_lock(&audio.requestLock);
+    audio.crossfade = seconds;
+    pthread_mutex_unlock(&audio.requestLock);
+}
+
+void audio_forget_track(MusicTrack *track) {
+    pthread_mutex_lock(&audio.lock);
+    pthread_mutex_lock(&audio.ringLock);
+
+    AudioSegment *heard = get_heard_segment();
+    if(audio.current == track || audio.next == track) cancel_fade();
+
+    for(size_t i = 0; i < audio.segments.count; i++) {
+        if(audio.segments.items[i].track != track) continue;
+
+        if(i == 0 && heard != NULL) {
+            // it's being heard, the output goes silent
+            restart_ring(NULL);
+            audio.current = NULL;
+        } else {
+            // spliced but not heard yet, the previous track ends the output again
+            audio.written = audio.segments.items[i].start;
+            audio.segments.count = i;
+            audio.current = audio.segments.items[i - 1].track;
+            audio.finished = false;
+        }
+        break;
+    }
+
+    if(audio.current == track) audio.current = NULL;
+    if(audio.next == track) audio.next = NULL;
+    if(audio.current == NULL) audio.finished = true;
+
+    pthread_mutex_unlock(&audio.ringLock);
+    pthread_mutex_unlock(&audio.lock);
+}
+
+MusicTrack *audio_get_playing(void) {
+    pthread_mutex_lock(&audio.ringLock);
+    AudioSegment *heard = get_heard_segment();
+    MusicTrack *track = heard == NULL ? NULL : heard->track;
+    pthread_mutex_unlock(&audio.ringLock);
+
+    return track;
+}
+
+float audio_get_time(void) {
+    pthread_mutex_lock(&audio.ringLock);
+
+    float time = 0;
+    AudioSegment *heard = get_heard_segment();
+    if(heard != NULL) {
+        uint64_t played = audio.read > heard->start ? audio.read - heard->start : 0;
+        time = (double)(heard->position + played) / heard->track->music.stream.sampleRate;
+    }
+
+    pthread_mutex_unlock(&audio.ringLock);
+    return time;
+}
+
+bool audio_is_finished(void) {
+    pthread_mutex_lock(&audio.ringLock);
+    bool finished = audio.finished && audio.read >= audio.written;
+    pthread_mutex_unlock(&audio.ringLock);
+
+    return finished;
+}
+
+void audio_play(void) {
+    audio.playing = true;
+    if(IsAudioStreamValid(audio.stream)) PlayAudioStream(audio.stream);
+}
+
+void audio_pause(void) {
+    audio.playing = false;
+    if(IsAudioStreamValid(audio.stream)) PauseAudioStream(audio.stream);
+}
+
+void audio_lock(void) {
+    pthread_mutex_lock(&audio.lock);
+}
+
+void audio_unlock(void) {
+    pthread_mutex_unlock(&audio.lock);
+}
+
+void audio_request_seek(float time) {
+    pthread_mutex_lock(&audio.requestLock);
+    audio.seekPending = true;
+    audio.seekTarget = time;
+    audio.seekRequest++;
+    pthread_mutex_unlock(&audio.requestLock);
+}
+
+void audio_flush_seek(void) {
+    pthread_mutex_lock(&audio.requestLock);
+    audio.seekFlush = audio.seekPending;
+    pthread_mutex_unlock(&audio.requestLock);
+}
+
+bool audio_get_pending_seek(float *time) {
+    pthread_mutex_lock(&audio.requestLock);
+    bool pending = audio.seekPending;
+    if(pending) *time = audio.seekTarget;
+    pthread_mutex_unlock(&audio.requestLock);
+
+    return pending;
+}
@@ -0,0 +1,50 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stdbool.h>
+
+#include "raylib.h"
+#include "player.h"
+
+// Plays the tracks through one output stream fed from its own thread, so the audio buffers stay full even
+// when a frame takes hundreds of milliseconds. The thread decodes ahead into a ring buffer that the
+// stream pulls from, and when the current track ends it continues with the next one in the same buffer,
+// so consecutive tracks with the same sample rate play without a gap or crossfaded. The calls that use the decoder of
+// a track given to the thread (bind_seek_index) have to be done between audio_lock and audio_unlock.
+
+void audio_init(void);
+void audio_close(void);
+
+// plays the track from its start instead of the current one, NULL stops
+// the stream is created again when the sample rate changes
+void audio_set_track(MusicTrack *track);
+// the track spliced after the current one, NULL cancels it
+void audio_set_next(MusicTrack *track);
+// the end of the current track is mixed with the start of the next one for this time, clamped to
+// MIXER_MAX_CROSSFADE, 0 plays them one after another
+void audio_set_crossfade(float seconds);
+// once it returns the thread doesn't reference the track anymore, a track being heard is cut
+void audio_forget_track(MusicTrack *track);
+
+// the track being heard, the next one becomes it right after the splice
+MusicTrack *audio_get_playing(void);
+// position of the track being heard in seconds
+float audio_get_time(void);
+// the current track is over without a next one to splice and everything decoded was played
+bool audio_is_finished(void);
+
+void audio_play(void);
+void audio_pause(void);
+
+// Seeks are coalesced: only the latest target is kept and the thread applies it when the previous seek
+// is at least AUDIO_SEEK_INTERVAL old, so dragging the slider costs a few real seeks.
+void audio_request_seek(float time);
+// applies the pending seek in the next refill without waiting for the interval
+void audio_flush_seek(void);
+// returns true while a requested seek wasn't applied, `time` gets its target
+bool audio_get_pending_seek(float *time);
+
+void audio_lock(void);
+void audio_unlock(void);
+
+#endif // AUDIO_H
@@ -0,0 +1,533 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "browser.h"
+#include "covers.h"
+
+#define BROWSER_TEXT_SIZE 20
+#define BROWSER_PADDING 10
+#define BROWSER_SEARCH_HEIGHT 40
+#define BROWSER_HEADER_HEIGHT 30
+#define BROWSER_ROW_HEIGHT 28
+#define BROWSER_CELL_SIZE COVER_THUMB_SIZE
+#define BROWSER_CELL_LABEL 50 // album and artist under the cover
+#define BROWSER_CELL_PADDING 20
+#define BROWSER_SCROLL_ROWS 3 // rows per step of the mouse wheel
+#define BROWSER_DOUBLE_CLICK 0.4 // seconds
+#define BROWSER_REFRESH_INTERVAL 1.0 // seconds between two rebuilds while the library changes
+#define BROWSER_FUZZY_MIN_LENGTH 4 // shorter queries without matches don't try the fuzzy search
+
+#define BROWSER_BACKGROUND_COLOR (Color){20, 20, 20, 255}
+#define BROWSER_SELECTED_COLOR (Color){40, 40, 90, 255}
+
+typedef struct {
+    const char *name;
+    LibrarySort sort;
+    float width; // part of the window
+} BrowserColumn;
+
+static const BrowserColumn browserColumns[] = {
+    {"Title", LIBRARY_SORT_TITLE, 0.4f},
+    {"Artist", LIBRARY_SORT_ARTIST, 0.25f},
+    {"Album", LIBRARY_SORT_ALBUM, 0.25f},
+    {"Time", LIBRARY_SORT_DURATION, 0.1f},
+};
+
+#define BROWSER_COLUMNS_COUNT (sizeof(browserColumns) / sizeof(browserColumns[0]))
+
+// cuts the text with "..." so it fits in the width, the result is valid until the next call
+static const char *fit_text(const char *text, int size, float maxWidth) {
+    if(MeasureText(text, size) <= maxWidth) return text;
+
+    static char buffer[256];
+    size_t length = strlen(text);
+    if(length > sizeof(buffer) - 4) length = sizeof(buffer) - 4;
+
+    while(length > 0) {
+        // back to the start of an utf-8 character
+        length--;
+        while(length > 0 && (text[length] & 0xC0) == 0x80) length--;
+
+        memcpy(buffer, text, length);
+        memcpy(buffer + length, "...", 4);
+        if(MeasureText(buffer, size) <= maxWidth) break;
+    }
+
+    return buffer;
+}
+
+static const char *get_column_text(const LibraryTrack *track, LibrarySort sort) {
+    switch(sort) {
+        case LIBRARY_SORT_ARTIST: return track->artist;
+        case LIBRARY_SORT_ALBUM: return track->album;
+        case LIBRARY_SORT_DURATION: {
+            int seconds = track->duration;
+            return seconds == 0 ? "" : TextFormat("%d:%02d", seconds / 60, seconds % 60);
+        }
+        case LIBRARY_SORT_TITLE:
+        default: return track->title;
+    }
+}
+
+// the tracks of an album are consecutive once the rows are sorted by artist, the lock has to be held
+static void group_albums(Browser *browser) {
+    const LibraryTable *table = library_get_table();
+    browser->albums.count = 0;
+
+    size_t previous = SIZE_MAX;
+    for(size_t i = 0; i < browser->rows.count; i++) {
+        size_t index = library_find_id(browser->rows.items[i]);
+        bool same = previous != SIZE_MAX && table->albumKey[index] == table->albumKey[previous]
+            && table->artistKey[index] == table->artistKey[previous];
+
+        if(same) {
+            browser->albums.items[browser->albums.count - 1].tracksCount++;
+        } else {
+            da_append(&browser->albums, ((BrowserAlbum){i, 1}));
+        }
+
+        previous = index;
+    }
+}
+
+// sorts the rows for the mode and groups the albums, the lock has to be held
+static void arrange_rows(Browser *browser) {
+    if(browser->mode == BROWSER_GRID) {
+        browser->rows.count = library_sort(browser->rows.items, browser->rows.count, LIBRARY_SORT_ARTIST, false);
+        group_albums(browser);
+    } else if(!browser->relevance || browser->query.count <= 1) {
+        browser->rows.count = library_sort(browser->rows.items, browser->rows.count, browser->sort, browser->descending);
+    }
+
+    size_t count = browser->mode == BROWSER_GRID ? browser->albums.count : browser->rows.count;
+    if(browser->selected >= count) browser->selected = count == 0 ? 0 : count - 1;
+}
+
+static void set_rows(Browser *browser, const uint32_t *ids, size_t count) {
+    browser->rows.count = 0;
+    da_append_many(&browser->rows, ids, count);
+
+    library_lock();
+    browser->libraryVersion = library_get_version();
+    arrange_rows(browser);
+    library_unlock();
+
+    browser->refreshTime = GetTime();
+}
+
+static void show_library(Browser *browser) {
+    library_lock();
+    const LibraryTable *table = library_get_table();
+    browser->rows.count = 0;
+    da_append_many(&browser->rows, table->id, table->count);
+    browser->libraryVersion = library_get_version();
+    arrange_rows(browser);
+    library_unlock();
+
+    browser->refreshTime = GetTime();
+}
+
+// the fuzzy search only runs when the words of the query don't start any word of the library
+static void run_search(Browser *browser) {
+    if(browser->query.count <= 1) {
+        browser->fuzzyPending = false;
+        browser->searchPending = false;
+        show_library(browser);
+        return;
+    }
+
+    // the index is being updated or the query continues, it's tried again in the next frame
+    if(!search_query(browser->query.items, &browser->results)) return;
+
+    browser->searchPending = false;
+    browser->fuzzyPending = false;
+    set_rows(browser, browser->results.ids.items, browser->results.ids.count);
+
+    if(browser->results.total == 0 && browser->query.count - 1 >= BROWSER_FUZZY_MIN_LENGTH) {
+        search_fuzzy_request(browser->query.items);
+        browser->fuzzyPending = true;
+    }
+}
+
+static void set_query_changed(Browser *browser) {
+    browser->searchPending = true;
+    browser->relevance = true;
+    browser->scroll = 0;
+    browser->selected = 0;
+}
+
+static void update_query(Browser *browser) {
+    if(browser->query.count == 0) da_append(&browser->query, '\0');
+
+    int codepoint;
+    while((codepoint = GetCharPressed()) != 0) {
+        browser->query.count--;
+        sb_append_utf8(&browser->query, codepoint);
+        da_append(&browser->query, '\0');
+        set_query_changed(browser);
+    }
+
+    if((IsKeyPressed(KEY_BACKSPACE) || IsKeyPressedRepeat(KEY_BACKSPACE)) && browser->query.count > 1) {
+        size_t length = browser->query.count - 1;
+        do length--; while(length > 0 && (browser->query.items[length] & 0xC0) == 0x80);
+
+        browser->query.items[length] = '\0';
+        browser->query.count = length + 1;
+        set_query_changed(browser);
+    }
+}
+
+// the rows follow the library at most once per BROWSER_REFRESH_INTERVAL while it's being scanned
+static void check_library_changes(Browser *browser) {
+    if(GetTime() - browser->refreshTime < BROWSER_REFRESH_INTERVAL) return;
+
+    library_lock();
+    bool changed = library_get_version() != browser->libraryVersion;
+    library_unlock();
+
+    if(changed) {
+        browser->searchPending = true;
+        browser->refreshTime = GetTime();
+    }
+}
+
+// the queue becomes the rows of the list or the tracks of the album, only their ids are copied and the
+// removed tracks are skipped by the player
+static void play_selected(Browser *browser, Player *player) {
+    size_t first = 0;
+    size_t count = browser->rows.count;
+    size_t start = browser->selected;
+
+    if(browser->mode == BROWSER_GRID) {
+        if(browser->selected >= browser->albums.count) return;
+        first = browser->albums.items[browser->selected].firstRow;
+        count = browser->albums.items[browser->selected].tracksCount;
+        start = 0;
+    }
+
+    if(start >= count) return;
+
+    player_clear_queue(player);
+    player_enqueue_tracks(player, browser->rows.items + first, count);
+
+    player->playing = true;
+    player_play_index(player, start);
+}
+
+static void select_item(Browser *browser, Player *player, size_t item) {
+    double time = GetTime();
+    bool doubleClick = browser->clicked == item && time - browser->clickTime < BROWSER_DOUBLE_CLICK;
+
+    browser->selected = item;
+    browser->clicked = item;
+    browser->clickTime = time;
+
+    if(doubleClick) play_selected(browser, player);
+}
+
+// the selection moves by the step and the scroll follows it
+static void move_selection(Browser *browser, long step, size_t count, float itemHeight, size_t perRow, float viewHeight) {
+    if(count == 0) return;
+
+    long selected = (long)browser->selected + step;
+    if(selected < 0) selected = 0;
+    if(selected >= (long)count) selected = count - 1;
+    browser->selected = selected;
+
+    float top = (browser->selected / perRow) * itemHeight;
+    if(top < browser->scroll) browser->scroll = top;
+    if(top + itemHeight > browser->scroll + viewHeight) browser->scroll = top + itemHeight - viewHeight;
+}
+
+static void update_scroll(Browser *browser, float contentHeight, float viewHeight, float itemHeight) {
+    browser->scroll -= GetMouseWheelMove() * itemHeight * (browser->mode == BROWSER_GRID ? 1 : BROWSER_SCROLL_ROWS);
+
+    float maxScroll = contentHeight - viewHeight;
+    if(browser->scroll > maxScroll) browser->scroll = maxScroll;
+    if(browser->scroll < 0) browser->scroll = 0;
+}
+
+static void update_selection_keys(Browser *browser, Player *player, size_t count, float itemHeight, size_t perRow, float viewHeight) {
+    long page = viewHeight / itemHeight * perRow;
+
+    if(IsKeyPressed(KEY_DOWN) || IsKeyPressedRepeat(KEY_DOWN)) move_selection(browser, perRow, count, itemHeight, perRow, viewHeight);
+    if(IsKeyPressed(KEY_UP) || IsKeyPressedRepeat(KEY_UP)) move_selection(browser, -(long)perRow, count, itemHeight, perRow, viewHeight);
+    if(perRow > 1 && (IsKeyPressed(KEY_RIGHT) || IsKeyPressedRepeat(KEY_RIGHT))) move_selection(browser, 1, count, itemHeight, perRow, viewHeight);
+    if(perRow > 1 && (IsKeyPressed(KEY_LEFT) || IsKeyPressedRepeat(KEY_LEFT))) move_selection(browser, -1, count, itemHeight, perRow, viewHeight);
+    if(IsKeyPressed(KEY_PAGE_DOWN) || IsKeyPressedRepeat(KEY_PAGE_DOWN)) move_selection(browser, page, count, itemHeight, perRow, viewHeight);
+    if(IsKeyPressed(KEY_PAGE_UP) || IsKeyPressedRepeat(KEY_PAGE_UP)) move_selection(browser, -page, count, itemHeight, perRow, viewHeight);
+    if(IsKeyPressed(KEY_HOME)) move_selection(browser, -(long)count, count, itemHeight, perRow, viewHeight);
+    if(IsKeyPressed(KEY_END)) move_selection(browser, count, count, itemHeight, perRow, viewHeight);
+
+    if(IsKeyPressed(KEY_ENTER)) play_selected(browser, player);
+}
+
+static void draw_search_bar(Browser *browser, Rectangle area) {
+    DrawRectangleRec(area, DARKGRAY);
+
+    int textY = area.y + (area.height - BROWSER_TEXT_SIZE) / 2;
+    bool empty = browser->query.count <= 1;
+    const char *query = empty ? "Type to search" : browser->query.items;
+    DrawText(fit_text(query, BROWSER_TEXT_SIZE, area.width / 2), area.x + BROWSER_PADDING, textY, BROWSER_TEXT_SIZE, empty ? GRAY : WHITE);
+
+    const char *status;
+    if(browser->fuzzyPending) status = "Searching...";
+    else if(empty) status = TextFormat("%zu tracks", browser->rows.count);
+    else status = TextFormat("%zu of %zu matches", browser->results.ids.count, browser->results.total);
+
+    int statusWidth = MeasureText(status, BROWSER_TEXT_SIZE);
+    DrawText(status, area.x + area.width - statusWidth - BROWSER_PADDING, textY, BROWSER_TEXT_SIZE, GRAY);
+}
+
+// a click on a column sorts by it, a second one reverses the order
+static void draw_list_header(Browser *browser, Rectangle area) {
+    Vector2 mousePos = GetMousePosition();
+    float x = area.x;
+
+    for(size_t i = 0; i < BROWSER_COLUMNS_COUNT; i++) {
+        const BrowserColumn *column = &browserColumns[i];
+        Rectangle rec = {x, area.y, area.width * column->width, area.height};
+        bool sorted = !browser->relevance || browser->query.count <= 1 ? browser->sort == column->sort : false;
+
+        const char *name = sorted ? TextFormat("%s %s", column->name, browser->descending ? "v" : "^") : column->name;
+        DrawText(name, rec.x + BROWSER_PADDING, rec.y + (rec.height - BROWSER_TEXT_SIZE) / 2, BROWSER_TEXT_SIZE, sorted ? WHITE : GRAY);
+
+        if(IsMouseButtonPressed(MOUSE_LEFT_BUTTON) && CheckCollisionPointRec(mousePos, rec)) {
+            browser->descending = sorted ? !browser->descending : false;
+            browser->sort = column->sort;
+            browser->relevance = false;
+
+            library_lock();
+            arrange_rows(browser);
+            library_unlock();
+        }
+
+        x += rec.width;
+    }
+}
+
+static void draw_list(Browser *browser, Player *player, Rectangle area) {
+    Rectangle header = {area.x, area.y, area.width, BROWSER_HEADER_HEIGHT};
+    Rectangle view = {area.x, area.y + header.height, area.width, area.height - header.height};
+    draw_list_header(browser, header);
+
+    size_t count = browser->rows.count;
+    update_scroll(browser, count * BROWSER_ROW_HEIGHT, view.height, BROWSER_ROW_HEIGHT);
+    update_selection_keys(browser, player, count, BROWSER_ROW_HEIGHT, 1, view.height);
+
+    size_t first = browser->scroll / BROWSER_ROW_HEIGHT;
+    size_t last = (browser->scroll + view.height) / BROWSER_ROW_HEIGHT + 1;
+    if(last > count) last = count;
+
+    Vector2 mousePos = GetMousePosition();
+    bool clicked = IsMouseButtonPressed(MOUSE_LEFT_BUTTON) && CheckCollisionPointRec(mousePos, view);
+    size_t clickedRow = SIZE_MAX;
+
+    BeginScissorMode(view.x, view.y, view.width, view.height);
+    library_lock();
+
+    for(size_t i = first; i < last; i++) {
+        Rectangle row = {view.x, view.y + i * BROWSER_ROW_HEIGHT - browser->scroll, view.width, BROWSER_ROW_HEIGHT};
+        if(i == browser->selected) DrawRectangleRec(row, BROWSER_SELECTED_COLOR);
+        if(clicked && CheckCollisionPointRec(mousePos, row)) clickedRow = i;
+
+        size_t index = library_find_id(browser->rows.items[i]);
+        if(index == SIZE_MAX) continue;
+
+        LibraryTrack track = library_get(index);
+        float x = row.x;
+
+        for(size_t c = 0; c < BROWSER_COLUMNS_COUNT; c++) {
+            float width = view.width * browserColumns[c].width;
+            const char *text = fit_text(get_column_text(&track, browserColumns[c].sort), BROWSER_TEXT_SIZE, width - BROWSER_PADDING * 2);
+            DrawText(text, x + BROWSER_PADDING, row.y + (BROWSER_ROW_HEIGHT - BROWSER_TEXT_SIZE) / 2, BROWSER_TEXT_SIZE, c == 0 ? WHITE : LIGHTGRAY);
+            x += width;
+        }
+    }
+
+    library_unlock();
+    EndScissorMode();
+
+    // playing needs the lock
+    if(clickedRow != SIZE_MAX) select_item(browser, player, clickedRow);
+}
+
+// the cover of the first track that has one, the lock has to be held
+static LibraryTrack get_album_cover_track(Browser *browser, const BrowserAlbum *album) {
+    LibraryTrack first = {0};
+
+    for(size_t i = 0; i < album->tracksCount; i++) {
+        size_t index = library_find_id(browser->rows.items[album->firstRow + i]);
+        if(index == SIZE_MAX) continue;
+
+        LibraryTrack track = library_get(index);
+        if(track.coverHash != 0) return track;
+        if(first.filePath == NULL) first = track;
+    }
+
+    return first;
+}
+
+// the covers of the page are drawn together before anything else, one run per atlas
+static void queue_album_cover(Browser *browser, const BrowserAlbum *album, Rectangle cell) {
+    BrowserCell visible = {.track = get_album_cover_track(browser, album)};
+    if(visible.track.filePath != NULL) visible.thumb = cover_get_thumb(visible.track.coverHash, visible.track.filePath);
+    da_append(&browser->cells, visible);
+
+    CoverThumbnail thumb = visible.thumb;
+    if(thumb.texture.id == 0) return;
+
+    // the thumbnail keeps its aspect ratio, centered in the square
+    Rectangle source = thumb.source;
+    float scale = (float)BROWSER_CELL_SIZE / (source.width > source.height ? source.width : source.height);
+    Rectangle dest = {
+        cell.x + (BROWSER_CELL_SIZE - source.width * scale) / 2,
+        cell.y + (BROWSER_CELL_SIZE - source.height * scale) / 2,
+        source.width * scale,
+        source.height * scale,
+    };
+
+    da_append(&browser->covers, ((BrowserCover){thumb.texture, source, dest}));
+}
+
+static int compare_covers(const void *a, const void *b) {
+    unsigned int textureA = ((const BrowserCover*)a)->texture.id;
+    unsigned int textureB = ((const BrowserCover*)b)->texture.id;
+    return (textureA > textureB) - (textureA < textureB);
+}
+
+static void draw_album_covers(Browser *browser) {
+    qsort(browser->covers.items, browser->covers.count, sizeof(BrowserCover), compare_covers);
+
+    for(size_t i = 0; i < browser->covers.count; i++) {
+        BrowserCover *cover = &browser->covers.items[i];
+        DrawTexturePro(cover->texture, cover->source, cover->dest, (Vector2){0}, 0, WHITE);
+    }
+
+    browser->covers.count = 0;
+}
+
+// the placeholder while the cover is loading, the selection and the names
+static void draw_album_label(const BrowserCell *visible, Rectangle cell, bool selected) {
+    LibraryTrack track = visible->track;
+    if(track.filePath == NULL) return;
+
+    Rectangle coverRec = {cell.x, cell.y, BROWSER_CELL_SIZE, BROWSER_CELL_SIZE};
+    if(visible->thumb.texture.id == 0) DrawRectangleRec(coverRec, DARKGRAY);
+    if(selected) DrawRectangleLinesEx(coverRec, 3, BLUE);
+
+    const char *name = track.album[0] == '\0' ? "Unknown album" : track.album;
+    int textSize = BROWSER_TEXT_SIZE - 2;
+    float y = cell.y + BROWSER_CELL_SIZE + 4;
+    DrawText(fit_text(name, textSize, BROWSER_CELL_SIZE), cell.x, y, textSize, WHITE);
+    DrawText(fit_text(track.artist, textSize, BROWSER_CELL_SIZE), cell.x, y + textSize + 4, textSize, GRAY);
+}
+
+static Rectangle get_cell_rec(Browser *browser, Rectangle area, size_t i, size_t perRow) {
+    float cellWidth = BROWSER_CELL_SIZE + BROWSER_CELL_PADDING;
+    float cellHeight = BROWSER_CELL_SIZE + BROWSER_CELL_LABEL + BROWSER_CELL_PADDING;
+
+    return (Rectangle){
+        area.x + BROWSER_CELL_PADDING + (i % perRow) * cellWidth,
+        area.y + BROWSER_CELL_PADDING + (i / perRow) * cellHeight - browser->scroll,
+        BROWSER_CELL_SIZE,
+        BROWSER_CELL_SIZE + BROWSER_CELL_LABEL,
+    };
+}
+
+static void draw_grid(Browser *browser, Player *player, Rectangle area) {
+    float cellWidth = BROWSER_CELL_SIZE + BROWSER_CELL_PADDING;
+    float cellHeight = BROWSER_CELL_SIZE + BROWSER_CELL_LABEL + BROWSER_CELL_PADDING;
+    size_t perRow = (area.width - BROWSER_CELL_PADDING) / cellWidth;
+    if(perRow == 0) perRow = 1;
+
+    size_t count = browser->albums.count;
+    size_t gridRows = (count + perRow - 1) / perRow;
+    update_scroll(browser, gridRows * cellHeight + BROWSER_CELL_PADDING, area.height, cellHeight);
+    update_selection_keys(browser, player, count, cellHeight, perRow, area.height);
+
+    size_t first = (size_t)(browser->scroll / cellHeight) * perRow;
+    size_t last = ((size_t)((browser->scroll + area.height) / cellHeight) + 1) * perRow;
+    if(last > count) last = count;
+
+    Vector2 mousePos = GetMousePosition();
+    bool clicked = IsMouseButtonPressed(MOUSE_LEFT_BUTTON) && CheckCollisionPointRec(mousePos, area);
+    size_t clickedCell = SIZE_MAX;
+
+    BeginScissorMode(area.x, area.y, area.width, area.height);
+    library_lock();
+
+    for(size_t i = first; i < last; i++) {
+        Rectangle cell = get_cell_rec(browser, area, i, perRow);
+        if(clicked && CheckCollisionPointRec(mousePos, cell)) clickedCell = i;
+        queue_album_cover(browser, &browser->albums.items[i], cell);
+    }
+
+    draw_album_covers(browser);
+
+    for(size_t i = first; i < last; i++) {
+        Rectangle cell = get_cell_rec(browser, area, i, perRow);
+        draw_album_label(&browser->cells.items[i - first], cell, i == browser->selected);
+    }
+
+    browser->cells.count = 0;
+
+    library_unlock();
+    EndScissorMode();
+
+    if(clickedCell != SIZE_MAX) select_item(browser, player, clickedCell);
+}
+
+void update_browser(Browser *browser, Player *player) {
+    if(IsKeyPressed(KEY_TAB)) {
+        browser->open = !browser->open;
+        if(browser->open && browser->rows.count == 0) browser->searchPending = true;
+        // the characters typed while it was closed aren't part of the query
+        while(GetCharPressed() != 0);
+    }
+
+    if(!browser->open) return;
+
+    if(IsKeyPressed(KEY_F2)) {
+        browser->mode = browser->mode == BROWSER_LIST ? BROWSER_GRID : BROWSER_LIST;
+        browser->scroll = 0;
+        browser->selected = 0;
+
+        library_lock();
+        arrange_rows(browser);
+        library_unlock();
+    }
+
+    update_query(browser);
+    check_library_changes(browser);
+    if(browser->searchPending) run_search(browser);
+
+    if(browser->fuzzyPending && search_fuzzy_poll(&browser->results)) {
+        browser->fuzzyPending = false;
+        set_rows(browser, browser->results.ids.items, browser->results.ids.count);
+    }
+
+    int width = GetScreenWidth();
+    int height = GetScreenHeight();
+    DrawRectangle(0, 0, width, height, BROWSER_BACKGROUND_COLOR);
+
+    Rectangle searchBar = {0, 0, width, BROWSER_SEARCH_HEIGHT};
+    Rectangle content = {0, searchBar.height, width, height - searchBar.height};
+    draw_search_bar(browser, searchBar);
+
+    if(browser->mode == BROWSER_GRID) {
+        draw_grid(browser, player, content);
+    } else {
+        draw_list(browser, player, content);
+    }
+}
+
+void unload_browser(Browser *browser) {
+    da_free(&browser->query);
+    da_free(&browser->results.ids);
+    da_free(&browser->rows);
+    da_free(&browser->albums);
+    da_free(&browser->covers);
+    da_free(&browser->cells);
+    memset(browser, 0, sizeof(Browser));
+}
@@ -0,0 +1,91 @@
+#ifndef BROWSER_H
+#define BROWSER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CCFuncs.h"
+#include "raylib.h"
+#include "library.h"
+#include "search.h"
+#include "player.h"
+#include "covers.h"
+
+// Library browser drawn over the player: a list of tracks with sortable columns or a grid of albums.
+// Only the rows and cells inside the window are drawn and only their covers are requested, the row
+// heights are fixed so the visible range comes straight from the scroll offset.
+
+typedef enum {
+    BROWSER_LIST,
+    BROWSER_GRID,
+} BrowserMode;
+
+typedef struct {
+    size_t firstRow; // the tracks of the album are consecutive in the rows
+    size_t tracksCount;
+} BrowserAlbum;
+
+typedef struct {
+    Texture2D texture; // atlas
+    Rectangle source;
+    Rectangle dest;
+} BrowserCover;
+
+// a visible cell of the grid, its cover is looked up once per frame for the cover and the label passes
+typedef struct {
+    LibraryTrack track; // the strings are valid while the library is locked
+    CoverThumbnail thumb;
+} BrowserCell;
+
+typedef struct {
+    bool open;
+    BrowserMode mode;
+
+    StringBuilder query; // null terminated
+    bool searchPending; // the query changed or the library did, it runs until the index is free and the query done
+    bool fuzzyPending; // nothing started with the query, waiting for the fuzzy search
+    bool relevance; // the rows of a search are in the order of the results until a column is sorted
+    SearchResults results;
+
+    struct {
+        uint32_t *items; // library track ids in the order they are shown
+        size_t count;
+        size_t capacity;
+    } rows;
+
+    struct {
+        BrowserAlbum *items; // grid cells
+        size_t count;
+        size_t capacity;
+    } albums;
+
+    struct {
+        BrowserCover *items; // visible covers of the grid, drawn by atlas
+        size_t count;
+        size_t capacity;
+    } covers;
+
+    struct {
+        BrowserCell *items; // visible cells of the grid in order
+        size_t count;
+        size_t capacity;
+    } cells;
+
+    LibrarySort sort;
+    bool descending;
+    unsigned long libraryVersion; // of the rows, see library_get_version
+    double refreshTime;
+
+    float scroll; // pixels from the top of the rows or cells
+    size_t selected; // row in the list, album in the grid
+    size_t clicked; // for the double click
+    double clickTime;
+} Browser;
+
+// tab opens and closes it, typing searches, F2 switches between the list and the grid
+// enter or a double click plays the selection, the other rows or the tracks of the album are queued
+void update_browser(Browser *browser, Player *player);
+void unload_browser(Browser *browser);
+
+#endif // BROWSER_H
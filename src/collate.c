@@ -0,0 +1,146 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "collate.h"
+#include "text.h"
+
+// the bytes of a key are the folded text except for these, all below the first printable character
+#define COLLATE_SPACE 0x01
+#define COLLATE_NUMBER 0x02 // followed by the number of digits and the digits without leading zeros
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+void make_collation_key(StringBuilder *sb, const char *str) {
+    StringBuilder folded = {0};
+    fold_text(&folded, str);
+    da_append(&folded, '\0');
+
+    const char *c = folded.items;
+    if(strncmp(c, "the ", 4) == 0 && c[4] != '\0') c += 4;
+
+    while(*c != '\0') {
+        if(*c == ' ') {
+            da_append(sb, COLLATE_SPACE);
+            c++;
+            continue;
+        }
+
+        if(!is_digit(*c)) {
+            da_append(sb, *c);
+            c++;
+            continue;
+        }
+
+        while(c[0] == '0' && is_digit(c[1])) c++;
+
+        size_t digits = 0;
+        while(is_digit(c[digits])) digits++;
+
+        // longer numbers are bigger, the count stops at 255 digits
+        da_append(sb, COLLATE_NUMBER);
+        da_append(sb, (char)(digits > 255 ? 255 : digits));
+        da_append_many(sb, c, digits);
+        c += digits;
+    }
+
+    da_append(sb, '\0');
+    da_free(&folded);
+}
+
+// the first 8 bytes of the key, big endian so the integers compare like the strings
+static uint64_t get_key_prefix(const char *key) {
+    uint64_t prefix = 0;
+    size_t i = 0;
+
+    for(; i < 8 && key[i] != '\0'; i++) prefix = prefix << 8 | (unsigned char)key[i];
+    return i == 0 ? 0 : prefix << (8 * (8 - i));
+}
+
+void radix_sort_pairs(uint64_t *keys, uint32_t *values, size_t count) {
+    uint64_t *tmpKeys = malloc(count * sizeof(uint64_t));
+    uint32_t *tmpValues = malloc(count * sizeof(uint32_t));
+    uint64_t *srcKeys = keys, *dstKeys = tmpKeys;
+    uint32_t *srcValues = values, *dstValues = tmpValues;
+
+    for(int shift = 0; shift < 64; shift += 8) {
+        size_t counts[256] = {0};
+        for(size_t i = 0; i < count; i++) counts[(srcKeys[i] >> shift) & 0xFF]++;
+
+        // the bytes that are the same in every key don't change the order
+        if(count == 0 || counts[(srcKeys[0] >> shift) & 0xFF] == count) continue;
+
+        size_t offset = 0;
+        for(int b = 0; b < 256; b++) {
+            size_t n = counts[b];
+            counts[b] = offset;
+            offset += n;
+        }
+
+        for(size_t i = 0; i < count; i++) {
+            size_t position = counts[(srcKeys[i] >> shift) & 0xFF]++;
+            dstKeys[position] = srcKeys[i];
+            dstValues[position] = srcValues[i];
+        }
+
+        uint64_t *swapKeys = srcKeys;
+        srcKeys = dstKeys;
+        dstKeys = swapKeys;
+        uint32_t *swapValues = srcValues;
+        srcValues = dstValues;
+        dstValues = swapValues;
+    }
+
+    if(srcKeys != keys) {
+        memcpy(keys, srcKeys, count * sizeof(uint64_t));
+        memcpy(values, srcValues, count * sizeof(uint32_t));
+    }
+
+    free(tmpKeys);
+    free(tmpValues);
+}
+
+// the interned keys of an album are the same pointer
+static int compare_keys(const char *a, const char *b) {
+    return a == b ? 0 : strcmp(a, b);
+}
+
+static void merge_sort(uint32_t *order, uint32_t *tmp, size_t count, const char *const *keys) {
+    if(count < 2) return;
+
+    size_t half = count / 2;
+    merge_sort(order, tmp, half, keys);
+    merge_sort(order + half, tmp, count - half, keys);
+    if(compare_keys(keys[order[half - 1]], keys[order[half]]) <= 0) return;
+
+    memcpy(tmp, order, half * sizeof(uint32_t));
+
+    size_t i = 0, j = half, k = 0;
+    while(i < half && j < count) {
+        if(compare_keys(keys[order[j]], keys[tmp[i]]) < 0) order[k++] = order[j++];
+        else order[k++] = tmp[i++];
+    }
+    while(i < half) order[k++] = tmp[i++];
+}
+
+void sort_by_keys(uint32_t *order, size_t count, const char *const *keys) {
+    uint64_t *prefixes = malloc(count * sizeof(uint64_t));
+    for(size_t i = 0; i < count; i++) prefixes[i] = get_key_prefix(keys[order[i]]);
+
+    radix_sort_pairs(prefixes, order, count);
+
+    // only keys of 8 bytes or more can have the same prefix and be different
+    uint32_t *tmp = malloc(count * sizeof(uint32_t));
+    for(size_t start = 0; start < count;) {
+        size_t end = start + 1;
+        while(end < count && prefixes[end] == prefixes[start]) end++;
+
+        if(end - start > 1 && (prefixes[start] & 0xFF) != 0) merge_sort(order + start, tmp, end - start, keys);
+        start = end;
+    }
+
+    free(tmp);
+    free(prefixes);
+}
@@ -0,0 +1,23 @@
+#ifndef COLLATE_H
+#define COLLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CCFuncs.h"
+
+// Binary keys that put the tags in the order a person expects with a plain strcmp: folded like the search
+// (see text.h), without a leading "the ", with numbers compared by their value ("track 2" before
+// "track 10") and spaces before every other character. They are computed once per track by the scanner.
+
+// appends the key of the string and its null terminator
+void make_collation_key(StringBuilder *sb, const char *str);
+
+// stable sort of the indices in order by keys[index]: radix sort of the first 8 bytes, then a merge sort
+// of the runs that share them
+void sort_by_keys(uint32_t *order, size_t count, const char *const *keys);
+
+// stable radix sort of the values by their 64 bit keys, both arrays are sorted
+void radix_sort_pairs(uint64_t *keys, uint32_t *values, size_t count);
+
+#endif // COLLATE_H
@@ -0,0 +1,390 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "CCFuncs.h"
+#include "covers.h"
+#include "rlgl.h"
+#include "tags.h"
+#include "exiftool.h"
+#include "thumbcache.h"
+
+// when more thumbnails are waiting the oldest requests are dropped, their cells were scrolled away
+#define COVERS_MAX_PENDING 64
+
+// uploads per frame, a scroll that shows a page of new covers spreads them over a few frames
+#define COVERS_UPLOAD_BYTES (1024 * 1024)
+#define COVERS_UPLOAD_TIME 0.003 // seconds
+
+#define COVERS_ATLAS_SIZE 2048
+#define COVERS_ATLAS_PADDING 2 // between the slots so the filtering doesn't sample the neighbours
+#define COVERS_SLOT_PITCH (COVER_THUMB_SIZE + COVERS_ATLAS_PADDING)
+#define COVERS_SLOTS_PER_ROW (COVERS_ATLAS_SIZE / COVERS_SLOT_PITCH)
+#define COVERS_SLOTS_PER_ATLAS (COVERS_SLOTS_PER_ROW * COVERS_SLOTS_PER_ROW)
+#define COVERS_ATLAS_BYTES ((size_t)COVERS_ATLAS_SIZE * COVERS_ATLAS_SIZE * 4)
+#define COVERS_MAX_ATLASES 16
+#define COVERS_MAX_SLOTS (COVERS_MAX_ATLASES * COVERS_SLOTS_PER_ATLAS)
+
+typedef enum {
+    COVER_QUEUED,
+    COVER_DROPPED, // requested again by the next call, after an eviction too
+    COVER_READY, // in an atlas slot
+    COVER_FAILED,
+} CoverState;
+
+typedef struct {
+    uint32_t hash; // 0 is an empty slot, tracks without cover have no thumbnail
+    CoverState state;
+    int slot;
+    int width;
+    int height;
+} CoverThumb;
+
+typedef struct {
+    uint32_t hash; // of the thumbnail in the slot, 0 when it's free
+    unsigned long lastUsed; // frame
+} AtlasSlot;
+
+typedef struct {
+    uint32_t hash;
+    char *filePath;
+} CoverRequest;
+
+typedef struct {
+    uint32_t hash;
+    Image image; // invalid when the picture couldn't be read
+} DecodedCover;
+
+static struct {
+    pthread_mutex_t lock; // protects the requests and the decoded covers
+    pthread_cond_t cond;
+    pthread_t thread;
+    bool running;
+    bool quit;
+
+    struct {
+        CoverRequest *items; // the newest is the last one, it's the first one read
+        size_t count;
+        size_t capacity;
+    } requests;
+
+    struct {
+        DecodedCover *items;
+        size_t count;
+        size_t capacity;
+    } decoded;
+
+    struct {
+        DecodedCover *items; // decoded covers waiting for the upload budget, only used by the main thread
+        size_t count;
+        size_t capacity;
+    } uploads;
+
+    // open addressing table by hash, only used by the main thread
+    struct {
+        CoverThumb *items;
+        size_t count;
+        size_t capacity;
+    } thumbs;
+
+    Texture2D atlases[COVERS_MAX_ATLASES];
+    int atlasesCount;
+    int maxAtlases; // from the vram budget
+    AtlasSlot slots[COVERS_MAX_SLOTS];
+    unsigned long frame;
+
+    CoverCacheStats stats;
+} covers = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+// the file is only read when the thumbnail isn't in the disk cache
+static Image load_thumb_image(uint32_t coverHash, const char *filePath) {
+    Image image;
+    if(thumb_cache_load(coverHash, COVER_THUMB_SIZE, &image)) return image;
+
+    MusicTags tags;
+    bool found = read_music_tags(filePath, &tags);
+
+    if(!found && !(exiftool_read_tags(&filePath, 1, &tags, &found) && found)) {
+        return (Image){0};
+    }
+
+    image = make_cover_thumb(coverHash, COVER_THUMB_SIZE, &tags);
+    unload_music_tags(&tags);
+
+    if(!IsImageValid(image)) {
+        log_error("Failed to load the cover from %s", filePath);
+        return (Image){0};
+    }
+
+    return image;
+}
+
+static void *covers_worker(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&covers.lock);
+
+    while(true) {
+        while(covers.requests.count == 0 && !covers.quit) {
+            pthread_cond_wait(&covers.cond, &covers.lock);
+        }
+
+        if(covers.quit) break;
+
+        CoverRequest request = covers.requests.items[--covers.requests.count];
+
+        pthread_mutex_unlock(&covers.lock);
+        Image image = load_thumb_image(request.hash, request.filePath);
+        free(request.filePath);
+        pthread_mutex_lock(&covers.lock);
+
+        da_append(&covers.decoded, ((DecodedCover){request.hash, image}));
+    }
+
+    pthread_mutex_unlock(&covers.lock);
+    return NULL;
+}
+
+static size_t find_thumb_slot(uint32_t hash) {
+    size_t mask = covers.thumbs.capacity - 1;
+    size_t slot = (hash * 2654435761u) & mask;
+
+    while(covers.thumbs.items[slot].hash != 0 && covers.thumbs.items[slot].hash != hash) {
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+// keeps the table at most half full
+static void grow_thumbs(void) {
+    if(covers.thumbs.capacity != 0 && (covers.thumbs.count + 1) * 2 <= covers.thumbs.capacity) return;
+
+    CoverThumb *old = covers.thumbs.items;
+    size_t oldCapacity = covers.thumbs.capacity;
+
+    covers.thumbs.capacity = oldCapacity == 0 ? 256 : oldCapacity * 2;
+    covers.thumbs.items = calloc(covers.thumbs.capacity, sizeof(CoverThumb));
+
+    for(size_t i = 0; i < oldCapacity; i++) {
+        if(old[i].hash != 0) covers.thumbs.items[find_thumb_slot(old[i].hash)] = old[i];
+    }
+
+    free(old);
+}
+
+static CoverThumb *find_thumb(uint32_t hash) {
+    if(covers.thumbs.capacity == 0) return NULL;
+
+    CoverThumb *thumb = &covers.thumbs.items[find_thumb_slot(hash)];
+    return thumb->hash == 0 ? NULL : thumb;
+}
+
+static void request_thumb(CoverThumb *thumb, const char *filePath) {
+    thumb->state = COVER_QUEUED;
+    covers.stats.misses++;
+
+    pthread_mutex_lock(&covers.lock);
+
+    if(covers.requests.count >= COVERS_MAX_PENDING) {
+        CoverRequest oldest = covers.requests.items[0];
+        covers.requests.count--;
+        memmove(covers.requests.items, covers.requests.items + 1, covers.requests.count * sizeof(CoverRequest));
+
+        CoverThumb *dropped = find_thumb(oldest.hash);
+        if(dropped != NULL) dropped->state = COVER_DROPPED;
+        free(oldest.filePath);
+    }
+
+    da_append(&covers.requests, ((CoverRequest){thumb->hash, strdup(filePath)}));
+    pthread_cond_signal(&covers.cond);
+
+    pthread_mutex_unlock(&covers.lock);
+}
+
+static Rectangle get_slot_rec(int slot, int width, int height) {
+    int index = slot % COVERS_SLOTS_PER_ATLAS;
+    float x = (index % COVERS_SLOTS_PER_ROW) * COVERS_SLOT_PITCH;
+    float y = (index / COVERS_SLOTS_PER_ROW) * COVERS_SLOT_PITCH;
+    return (Rectangle){x, y, width, height};
+}
+
+static bool add_atlas(void) {
+    // the storage is allocated without uploading 16 MB of blank pixels, only the slots are ever written
+    Texture2D atlas = {
+        .id = rlLoadTexture(NULL, COVERS_ATLAS_SIZE, COVERS_ATLAS_SIZE, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8, 1),
+        .width = COVERS_ATLAS_SIZE,
+        .height = COVERS_ATLAS_SIZE,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+    };
+
+    if(atlas.id == 0) {
+        log_error("Failed to create a covers atlas of %d pixels", COVERS_ATLAS_SIZE);
+        return false;
+    }
+
+    SetTextureFilter(atlas, TEXTURE_FILTER_BILINEAR);
+    covers.atlases[covers.atlasesCount++] = atlas;
+    covers.stats.vramUsed += COVERS_ATLAS_BYTES;
+    return true;
+}
+
+// a free slot, a new atlas or the slot drawn the longest time ago, -1 when they were all drawn in this frame
+static int allocate_slot(void) {
+    int slotsCount = covers.atlasesCount * COVERS_SLOTS_PER_ATLAS;
+
+    for(int i = 0; i < slotsCount; i++) {
+        if(covers.slots[i].hash == 0) return i;
+    }
+
+    if(covers.atlasesCount < covers.maxAtlases && add_atlas()) return slotsCount;
+
+    int oldest = -1;
+    for(int i = 0; i < slotsCount; i++) {
+        if(covers.slots[i].lastUsed == covers.frame) continue;
+        if(oldest == -1 || covers.slots[i].lastUsed < covers.slots[oldest].lastUsed) oldest = i;
+    }
+
+    if(oldest == -1) return -1;
+
+    CoverThumb *evicted = find_thumb(covers.slots[oldest].hash);
+    if(evicted != NULL) evicted->state = COVER_DROPPED;
+    covers.slots[oldest].hash = 0;
+    covers.stats.evictions++;
+
+    return oldest;
+}
+
+CoverThumbnail cover_get_thumb(uint32_t coverHash, const char *filePath) {
+    if(coverHash == 0) return (CoverThumbnail){0};
+
+    CoverThumb *thumb = find_thumb(coverHash);
+
+    if(thumb == NULL) {
+        grow_thumbs();
+        thumb = &covers.thumbs.items[find_thumb_slot(coverHash)];
+        *thumb = (CoverThumb){.hash = coverHash, .slot = -1};
+        covers.thumbs.count++;
+        request_thumb(thumb, filePath);
+    } else if(thumb->state == COVER_DROPPED) {
+        request_thumb(thumb, filePath);
+    }
+
+    if(thumb->state != COVER_READY) return (CoverThumbnail){0};
+
+    covers.stats.hits++;
+    covers.slots[thumb->slot].lastUsed = covers.frame;
+    return (CoverThumbnail){
+        .texture = covers.atlases[thumb->slot / COVERS_SLOTS_PER_ATLAS],
+        .source = get_slot_rec(thumb->slot, thumb->width, thumb->height),
+    };
+}
+
+static void upload_thumb(CoverThumb *thumb, Image image) {
+    int slot = allocate_slot();
+
+    // every slot is on screen, it's tried again later
+    if(slot == -1) {
+        thumb->state = COVER_DROPPED;
+        return;
+    }
+
+    covers.slots[slot] = (AtlasSlot){thumb->hash, covers.frame};
+    UpdateTextureRec(covers.atlases[slot / COVERS_SLOTS_PER_ATLAS], get_slot_rec(slot, image.width, image.height), image.data);
+
+    thumb->state = COVER_READY;
+    thumb->slot = slot;
+    thumb->width = image.width;
+    thumb->height = image.height;
+}
+
+// the decoded covers are moved to the uploads, then uploaded within the budget of the frame
+static void upload_decoded(void) {
+    // the main thread calls this every frame, it never waits for the worker
+    if(pthread_mutex_trylock(&covers.lock) == 0) {
+        da_append_many(&covers.uploads, covers.decoded.items, covers.decoded.count);
+        covers.decoded.count = 0;
+        pthread_mutex_unlock(&covers.lock);
+    }
+
+    double start = GetTime();
+    size_t bytes = 0;
+
+    // the newest first, it's the most likely to be on screen
+    while(covers.uploads.count > 0 && bytes < COVERS_UPLOAD_BYTES && GetTime() - start < COVERS_UPLOAD_TIME) {
+        DecodedCover decoded = covers.uploads.items[--covers.uploads.count];
+        CoverThumb *thumb = find_thumb(decoded.hash);
+
+        if(thumb != NULL && thumb->state == COVER_QUEUED && IsImageValid(decoded.image)) {
+            upload_thumb(thumb, decoded.image);
+            bytes += (size_t)decoded.image.width * decoded.image.height * 4;
+        } else if(thumb != NULL && thumb->state == COVER_QUEUED) {
+            thumb->state = COVER_FAILED;
+        }
+
+        if(decoded.image.data != NULL) UnloadImage(decoded.image);
+    }
+}
+
+void update_covers(void) {
+    upload_decoded();
+    // the slots drawn in the last frame can't be evicted by the uploads above
+    covers.frame++;
+}
+
+void covers_init(size_t vramBudget) {
+    covers.quit = false;
+
+    covers.maxAtlases = vramBudget / COVERS_ATLAS_BYTES;
+    if(covers.maxAtlases < 1) covers.maxAtlases = 1;
+    if(covers.maxAtlases > COVERS_MAX_ATLASES) covers.maxAtlases = COVERS_MAX_ATLASES;
+    covers.stats.vramBudget = covers.maxAtlases * COVERS_ATLAS_BYTES;
+
+    if(pthread_create(&covers.thread, NULL, covers_worker, NULL) != 0) {
+        log_error("Failed to start the covers thread (%s)", "pthread_create");
+        return;
+    }
+
+    covers.running = true;
+}
+
+CoverCacheStats covers_get_stats(void) {
+    return covers.stats;
+}
+
+void covers_close(void) {
+    if(covers.running) {
+        pthread_mutex_lock(&covers.lock);
+        covers.quit = true;
+        pthread_cond_signal(&covers.cond);
+        pthread_mutex_unlock(&covers.lock);
+
+        pthread_join(covers.thread, NULL);
+        covers.running = false;
+    }
+
+    for(size_t i = 0; i < covers.requests.count; i++) free(covers.requests.items[i].filePath);
+    for(size_t i = 0; i < covers.decoded.count; i++) {
+        if(covers.decoded.items[i].image.data != NULL) UnloadImage(covers.decoded.items[i].image);
+    }
+    for(size_t i = 0; i < covers.uploads.count; i++) {
+        if(covers.uploads.items[i].image.data != NULL) UnloadImage(covers.uploads.items[i].image);
+    }
+    for(int i = 0; i < covers.atlasesCount; i++) UnloadTexture(covers.atlases[i]);
+
+    da_free(&covers.requests);
+    da_free(&covers.decoded);
+    da_free(&covers.uploads);
+    free(covers.thumbs.items);
+    memset(&covers.requests, 0, sizeof(covers.requests));
+    memset(&covers.decoded, 0, sizeof(covers.decoded));
+    memset(&covers.uploads, 0, sizeof(covers.uploads));
+    memset(&covers.thumbs, 0, sizeof(covers.thumbs));
+    memset(covers.slots, 0, sizeof(covers.slots));
+    covers.atlasesCount = 0;
+    covers.stats.vramUsed = 0;
+}
@@ -0,0 +1,47 @@
+#ifndef COVERS_H
+#define COVERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "raylib.h"
+
+// Thumbnails of the embedded covers for the library browser, identified by the crc32 of the picture
+// (LibraryTable.coverHash) so the tracks of an album share one. A thumbnail is read and scaled by a
+// background thread the first time a visible cell asks for it, the main thread only uploads it.
+//
+// The thumbnails are packed in the fixed size slots of a few atlas textures, so a page of the grid is
+// drawn from one texture without switching it between the covers. When every slot is taken the one that
+// wasn't drawn for the longest time is reused, its thumbnail is read again if it's needed later. The
+// slots drawn in the last frame are pinned, and the atlases are limited by the vram budget.
+
+#define COVER_THUMB_SIZE 160 // the longest side of a thumbnail
+
+typedef struct {
+    unsigned long hits; // lookups of a thumbnail that was ready, the grid does one per visible cell and frame
+    unsigned long misses; // thumbnails read from the cache file or the music file
+    unsigned long evictions;
+    size_t vramUsed; // bytes
+    size_t vramBudget;
+} CoverCacheStats;
+
+// the budget is rounded down to whole atlases of 16 MB, there's at least one
+void covers_init(size_t vramBudget);
+// stops the thread and unloads the thumbnails
+void covers_close(void);
+
+typedef struct {
+    Texture2D texture; // atlas, the id is 0 while the thumbnail is loading or when the picture couldn't be read
+    Rectangle source; // of the thumbnail in the atlas
+} CoverThumbnail;
+
+// returns the thumbnail and marks it as used in this frame
+// the file is only read on the first call for the hash or after the thumbnail was evicted
+CoverThumbnail cover_get_thumb(uint32_t coverHash, const char *filePath);
+// uploads the decoded thumbnails within a per frame budget of bytes and time, the cells draw a
+// placeholder until theirs arrives, it has to be called from the main thread
+void update_covers(void);
+
+CoverCacheStats covers_get_stats(void);
+
+#endif // COVERS_H
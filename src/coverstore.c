@@ -0,0 +1,176 @@
+#include <string.h>
+#include <pthread.h>
+
+#include "CCFuncs.h"
+#include "coverstore.h"
+
+typedef struct {
+    uint32_t hash;
+    int refCount; // pinned while it's above 0
+    unsigned long lastReleased; // release counter when the last reference was released
+    size_t vramSize; // of the texture with its mipmaps, counted from the add
+    Image image; // until it's uploaded
+    Texture2D texture;
+} StoredCover;
+
+// only the current and the next tracks are loaded and the budget is a few covers, so it's a short array
+static struct {
+    pthread_mutex_t lock; // the loader thread adds the covers and the main thread uploads them
+    struct {
+        StoredCover *items;
+        size_t count;
+        size_t capacity;
+    } covers;
+
+    unsigned long releases;
+    CoverCacheStats stats;
+} coverStore = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static StoredCover *find_cover(uint32_t coverHash) {
+    for(size_t i = 0; i < coverStore.covers.count; i++) {
+        if(coverStore.covers.items[i].hash == coverHash) return &coverStore.covers.items[i];
+    }
+
+    return NULL;
+}
+
+static void unload_stored_cover(StoredCover *cover) {
+    if(cover->image.data != NULL) UnloadImage(cover->image);
+    if(cover->texture.id != 0) UnloadTexture(cover->texture);
+}
+
+// unloads the covers without references from the least recently released one, the lock has to be held
+static void trim_covers(void) {
+    while(coverStore.stats.vramUsed > coverStore.stats.vramBudget) {
+        StoredCover *oldest = NULL;
+
+        for(size_t i = 0; i < coverStore.covers.count; i++) {
+            StoredCover *cover = &coverStore.covers.items[i];
+            if(cover->refCount == 0 && (oldest == NULL || cover->lastReleased < oldest->lastReleased)) oldest = cover;
+        }
+
+        // everything left is pinned
+        if(oldest == NULL) return;
+
+        coverStore.stats.vramUsed -= oldest->vramSize;
+        coverStore.stats.evictions++;
+        unload_stored_cover(oldest);
+        *oldest = coverStore.covers.items[--coverStore.covers.count];
+    }
+}
+
+void cover_store_init(size_t vramBudget) {
+    coverStore.stats.vramBudget = vramBudget;
+}
+
+bool cover_store_acquire(uint32_t coverHash) {
+    if(coverHash == 0) return false;
+
+    pthread_mutex_lock(&coverStore.lock);
+    StoredCover *cover = find_cover(coverHash);
+    if(cover != NULL) cover->refCount++;
+
+    if(cover != NULL) coverStore.stats.hits++;
+    else coverStore.stats.misses++;
+
+    pthread_mutex_unlock(&coverStore.lock);
+
+    return cover != NULL;
+}
+
+void cover_store_add(uint32_t coverHash, Image image) {
+    pthread_mutex_lock(&coverStore.lock);
+
+    StoredCover *cover = find_cover(coverHash);
+    if(cover != NULL) {
+        // decoded twice, the first one is kept
+        cover->refCount++;
+        UnloadImage(image);
+    } else {
+        // the mipmaps add a third
+        size_t vramSize = (size_t)image.width * image.height * 4 * 4 / 3;
+        da_append(&coverStore.covers, ((StoredCover){.hash = coverHash, .refCount = 1, .vramSize = vramSize, .image = image}));
+        coverStore.stats.vramUsed += vramSize;
+    }
+
+    pthread_mutex_unlock(&coverStore.lock);
+}
+
+void cover_store_release(uint32_t coverHash) {
+    if(coverHash == 0) return;
+
+    pthread_mutex_lock(&coverStore.lock);
+
+    StoredCover *cover = find_cover(coverHash);
+    if(cover != NULL && --cover->refCount == 0) {
+        cover->lastReleased = ++coverStore.releases;
+        trim_covers();
+    }
+
+    pthread_mutex_unlock(&coverStore.lock);
+}
+
+void cover_store_upload(uint32_t coverHash) {
+    if(coverHash == 0) return;
+
+    pthread_mutex_lock(&coverStore.lock);
+
+    StoredCover *cover = find_cover(coverHash);
+    if(cover != NULL && cover->texture.id == 0 && IsImageValid(cover->image)) {
+        cover->texture = LoadTextureFromImage(cover->image);
+        // smaller views of the cover sample the mipmaps instead of skipping texels
+        GenTextureMipmaps(&cover->texture);
+        SetTextureFilter(cover->texture, TEXTURE_FILTER_TRILINEAR);
+
+        UnloadImage(cover->image);
+        cover->image = (Image){0};
+    }
+
+    // the loader thread can't unload the textures when it adds a cover over the budget
+    trim_covers();
+
+    pthread_mutex_unlock(&coverStore.lock);
+}
+
+Texture2D cover_store_get(uint32_t coverHash) {
+    if(coverHash == 0) return (Texture2D){0};
+
+    pthread_mutex_lock(&coverStore.lock);
+    StoredCover *cover = find_cover(coverHash);
+    Texture2D texture = cover == NULL ? (Texture2D){0} : cover->texture;
+    pthread_mutex_unlock(&coverStore.lock);
+
+    return texture;
+}
+
+size_t cover_store_get_size(uint32_t coverHash) {
+    if(coverHash == 0) return 0;
+
+    pthread_mutex_lock(&coverStore.lock);
+    StoredCover *cover = find_cover(coverHash);
+    size_t size = cover == NULL ? 0 : cover->vramSize;
+    pthread_mutex_unlock(&coverStore.lock);
+
+    return size;
+}
+
+CoverCacheStats cover_store_get_stats(void) {
+    pthread_mutex_lock(&coverStore.lock);
+    CoverCacheStats stats = coverStore.stats;
+    pthread_mutex_unlock(&coverStore.lock);
+
+    return stats;
+}
+
+void cover_store_close(void) {
+    pthread_mutex_lock(&coverStore.lock);
+
+    for(size_t i = 0; i < coverStore.covers.count; i++) unload_stored_cover(&coverStore.covers.items[i]);
+    da_free(&coverStore.covers);
+    memset(&coverStore.covers, 0, sizeof(coverStore.covers));
+    coverStore.stats.vramUsed = 0;
+
+    pthread_mutex_unlock(&coverStore.lock);
+}
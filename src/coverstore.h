@@ -0,0 +1,38 @@
+#ifndef COVERSTORE_H
+#define COVERSTORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "raylib.h"
+#include "covers.h"
+
+// Decoded covers of the loaded tracks, identified by the crc32 of the picture. A MusicTrack holds a
+// reference to its cover instead of its own image and texture, so the tracks of an album that are loaded
+// one after the other share a single decode and a single upload. A referenced cover is pinned, the ones
+// without references stay loaded for when the track comes back until the vram budget is exceeded, then the
+// least recently released one is unloaded.
+
+// the budget is for all the covers, the referenced ones can exceed it
+void cover_store_init(size_t vramBudget);
+
+// takes a reference to the cover when it's already in the store, then it doesn't have to be decoded
+bool cover_store_acquire(uint32_t coverHash);
+// adds the decoded cover with one reference, the store owns the image
+void cover_store_add(uint32_t coverHash, Image image);
+// it has to be called from the main thread, it can unload textures
+void cover_store_release(uint32_t coverHash);
+
+// uploads the cover if it isn't yet, it has to be called from the main thread
+void cover_store_upload(uint32_t coverHash);
+// the id of the texture is 0 until the cover is uploaded
+Texture2D cover_store_get(uint32_t coverHash);
+// bytes of the texture with its mipmaps, 0 for a cover that isn't in the store
+size_t cover_store_get_size(uint32_t coverHash);
+
+CoverCacheStats cover_store_get_stats(void);
+
+// unloads every cover, even the ones that still have references
+void cover_store_close(void);
+
+#endif // COVERSTORE_H
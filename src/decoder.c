@@ -0,0 +1,190 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "CCFuncs.h"
+#include "decoder.h"
+
+#define DECODER_CHUNK 1024 // frames decoded at once into the stack buffer
+#define DECODER_MAX_CHANNELS 8
+#define QOA_FRAME_LENGTH 5120 // pcm frames of a qoa frame, it seeks to their starts
+#define QOA_FRAME_BYTES(channels) (8 + 16 * (channels) + 256 * 8 * (channels)) // with its 256 slices
+
+// what the decoders allocate besides the file data, from dr_wav and dr_mp3
+#define DECODER_WAV_MEMORY (4 * 1024) // state and read cache
+#define DECODER_MP3_MEMORY (80 * 1024) // minimp3 state, the pcm of a frame and the 64 KB input buffer
+#define DECODER_STREAM_PERIOD 30 // raudio 5.5 sizes the stream buffers in 1/30 s periods, it keeps two
+
+// the decoders are linked inside libraylib.a
+typedef struct drwav drwav;
+typedef struct drmp3 drmp3;
+typedef struct stb_vorbis stb_vorbis;
+typedef struct qoaplay_desc qoaplay_desc;
+typedef struct jar_xm_context_s jar_xm_context_t;
+typedef struct jar_mod_context_s jar_mod_context_t;
+
+// same layout as stb_vorbis_info
+typedef struct {
+    unsigned int sampleRate;
+    int channels;
+    unsigned int setupMemoryRequired;
+    unsigned int setupTempMemoryRequired;
+    unsigned int tempMemoryRequired;
+    int maxFrameSize;
+} VorbisInfo;
+
+uint64_t drwav_read_pcm_frames_f32(drwav *wav, uint64_t framesToRead, float *out);
+unsigned int drwav_seek_to_pcm_frame(drwav *wav, uint64_t frame);
+uint64_t drmp3_read_pcm_frames_f32(drmp3 *mp3, uint64_t framesToRead, float *out);
+unsigned int drmp3_seek_to_pcm_frame(drmp3 *mp3, uint64_t frame);
+int stb_vorbis_get_samples_float_interleaved(stb_vorbis *vorbis, int channels, float *buffer, int floats);
+int stb_vorbis_seek(stb_vorbis *vorbis, unsigned int sample);
+unsigned int qoaplay_decode(qoaplay_desc *qoa, float *out, int frames);
+void qoaplay_seek_frame(qoaplay_desc *qoa, int frame);
+void jar_xm_generate_samples(jar_xm_context_t *xm, float *out, size_t frames);
+void jar_xm_reset(jar_xm_context_t *xm);
+void jar_mod_fillbuffer(jar_mod_context_t *mod, short *out, unsigned long frames, void *trackerState);
+void jar_mod_seek_start(jar_mod_context_t *mod);
+VorbisInfo stb_vorbis_get_info(stb_vorbis *vorbis);
+
+static unsigned int get_channels(Music music) {
+    // the modules are always rendered in stereo
+    if(music.ctxType == RAUDIO_CONTEXT_XM || music.ctxType == RAUDIO_CONTEXT_MOD) return 2;
+    return music.stream.channels;
+}
+
+// interleaved frames in the channels of the music, `frames` is at most DECODER_CHUNK
+static unsigned int read_decoder(Music music, float *out, unsigned int frames) {
+    switch(music.ctxType) {
+        case RAUDIO_CONTEXT_WAV: return drwav_read_pcm_frames_f32(music.ctxData, frames, out);
+        case RAUDIO_CONTEXT_MP3: return drmp3_read_pcm_frames_f32(music.ctxData, frames, out);
+        case RAUDIO_CONTEXT_QOA: return qoaplay_decode(music.ctxData, out, frames);
+        case RAUDIO_CONTEXT_OGG: {
+            int channels = music.stream.channels;
+            return stb_vorbis_get_samples_float_interleaved(music.ctxData, channels, out, frames * channels);
+        }
+        case RAUDIO_CONTEXT_XM: {
+            jar_xm_generate_samples(music.ctxData, out, frames);
+            return frames;
+        }
+        case RAUDIO_CONTEXT_MOD: {
+            // the 16 bits frames take the first half of the buffer, they're converted from the end
+            short *samples = (short*)out;
+            jar_mod_fillbuffer(music.ctxData, samples, frames, NULL);
+            for(unsigned int i = frames * 2; i-- > 0;) out[i] = samples[i] / 32768.0f;
+            return frames;
+        }
+        default: return 0;
+    }
+}
+
+static void seek_decoder(Music music, uint64_t frame) {
+    switch(music.ctxType) {
+        case RAUDIO_CONTEXT_WAV: drwav_seek_to_pcm_frame(music.ctxData, frame); break;
+        case RAUDIO_CONTEXT_MP3: drmp3_seek_to_pcm_frame(music.ctxData, frame); break;
+        case RAUDIO_CONTEXT_OGG: stb_vorbis_seek(music.ctxData, frame); break;
+        case RAUDIO_CONTEXT_QOA: {
+            qoaplay_seek_frame(music.ctxData, frame / QOA_FRAME_LENGTH);
+
+            // the rest of the way is decoded
+            float buffer[DECODER_CHUNK * DECODER_MAX_CHANNELS];
+            unsigned int skip = frame % QOA_FRAME_LENGTH;
+            while(skip > 0) {
+                unsigned int count = skip < DECODER_CHUNK ? skip : DECODER_CHUNK;
+                qoaplay_decode(music.ctxData, buffer, count);
+                skip -= count;
+            }
+            break;
+        }
+        case RAUDIO_CONTEXT_XM: if(frame == 0) jar_xm_reset(music.ctxData); break;
+        case RAUDIO_CONTEXT_MOD: if(frame == 0) jar_mod_seek_start(music.ctxData); break;
+        default: break;
+    }
+}
+
+void init_track_decoder(MusicTrack *track, unsigned int trimStart, unsigned int trimEnd) {
+    uint64_t frameCount = track->music.frameCount;
+    bool seekable = track->music.ctxType != RAUDIO_CONTEXT_XM && track->music.ctxType != RAUDIO_CONTEXT_MOD;
+
+    // a broken header can't leave nothing to play
+    if(!seekable || (uint64_t)trimStart + trimEnd >= frameCount) {
+        trimStart = 0;
+        trimEnd = 0;
+    }
+
+    track->trimStart = trimStart;
+    track->frameCount = frameCount - trimStart - trimEnd;
+    track->position = 0;
+
+    if(trimStart > 0) seek_decoder(track->music, trimStart);
+}
+
+unsigned int read_track_frames(MusicTrack *track, float *out, unsigned int frames) {
+    unsigned int channels = get_channels(track->music);
+    if(channels == 0 || channels > DECODER_MAX_CHANNELS) return 0;
+
+    float buffer[DECODER_CHUNK * DECODER_MAX_CHANNELS];
+    unsigned int total = 0;
+
+    while(total < frames && track->position < track->frameCount) {
+        uint64_t left = track->frameCount - track->position;
+        unsigned int count = frames - total;
+        if(count > DECODER_CHUNK) count = DECODER_CHUNK;
+        if(count > left) count = left;
+
+        unsigned int read = read_decoder(track->music, buffer, count);
+        if(read == 0) {
+            // the file is shorter than its header said
+            track->frameCount = track->position;
+            break;
+        }
+
+        // mono is played on both sides, only the front left and right of the other layouts are kept
+        float *dst = out + total * DECODER_CHANNELS;
+        for(unsigned int i = 0; i < read; i++) {
+            const float *src = buffer + i * channels;
+            dst[i * 2] = src[0];
+            dst[i * 2 + 1] = channels == 1 ? src[0] : src[1];
+        }
+
+        total += read;
+        track->position += read;
+    }
+
+    return total;
+}
+
+size_t get_decoder_memory(const MusicTrack *track) {
+    Music music = track->music;
+    if(music.ctxData == NULL) return 0;
+
+    // the buffer of the stream is at the rate of the device, the one of the music is close enough
+    size_t stream = (size_t)music.stream.sampleRate / DECODER_STREAM_PERIOD * 2 * music.stream.channels * music.stream.sampleSize / 8;
+
+    switch(music.ctxType) {
+        case RAUDIO_CONTEXT_WAV: return stream + DECODER_WAV_MEMORY;
+        case RAUDIO_CONTEXT_MP3: return stream + DECODER_MP3_MEMORY;
+        case RAUDIO_CONTEXT_OGG: {
+            VorbisInfo info = stb_vorbis_get_info(music.ctxData);
+            return stream + info.setupMemoryRequired + info.tempMemoryRequired;
+        }
+        case RAUDIO_CONTEXT_QOA: {
+            // a frame of the file and its decoded samples
+            size_t channels = music.stream.channels;
+            return stream + QOA_FRAME_BYTES(channels) + QOA_FRAME_LENGTH * channels * sizeof(short);
+        }
+        case RAUDIO_CONTEXT_XM:
+        case RAUDIO_CONTEXT_MOD:
+            // the whole module is kept in memory, its samples take most of the file
+            return stream + GetFileLength(track->info.filePath);
+        default: return stream;
+    }
+}
+
+void seek_track_frame(MusicTrack *track, uint64_t frame) {
+    bool seekable = track->music.ctxType != RAUDIO_CONTEXT_XM && track->music.ctxType != RAUDIO_CONTEXT_MOD;
+    if(!seekable && frame != 0) return;
+
+    if(frame > track->frameCount) frame = track->frameCount;
+    seek_decoder(track->music, track->trimStart + frame);
+    track->position = frame;
+}
@@ -0,0 +1,36 @@
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <stdint.h>
+
+#include "player.h"
+
+// Reads the pcm of a track straight from the raudio decoder in Music.ctxData, its own audio stream is
+// never played. The audio thread splices the frames of consecutive tracks in one output stream (see
+// audio.h) so there's no gap between them. The frames are stereo floats and the encoder delay and
+// padding of the mp3 files are left out.
+
+#define DECODER_CHANNELS 2
+
+// Music.ctxType, the MUSIC_AUDIO_* values of raudio.c in raylib 5.5, FLAC isn't compiled in by default
+#define RAUDIO_CONTEXT_WAV 1
+#define RAUDIO_CONTEXT_OGG 2
+#define RAUDIO_CONTEXT_MP3 4
+#define RAUDIO_CONTEXT_QOA 5
+#define RAUDIO_CONTEXT_XM 6
+#define RAUDIO_CONTEXT_MOD 7
+
+// sets the playable range of a loaded track and moves its decoder to the first frame
+void init_track_decoder(MusicTrack *track, unsigned int trimStart, unsigned int trimEnd);
+
+// reads up to `frames` frames at the position of the track, fewer only at its end
+unsigned int read_track_frames(MusicTrack *track, float *out, unsigned int frames);
+
+// the frame is counted from the trimmed start, the tracker modules can only go back to the start
+void seek_track_frame(MusicTrack *track, uint64_t frame);
+
+// bytes allocated by raudio for the music: its stream buffers and the state of its decoder, estimated
+// from the format (and the module size) since raudio doesn't expose them
+size_t get_decoder_memory(const MusicTrack *track);
+
+#endif // DECODER_H
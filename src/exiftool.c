@@ -0,0 +1,435 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "CCFuncs.h"
+#include "exiftool.h"
+
+#define EXIFTOOL_READ_CHUNK 4096
+#define EXIFTOOL_PICTURE_PREFIX "base64:"
+
+typedef enum {
+    JSON_DEFAULT = 0,
+    JSON_STRING,
+    JSON_ESCAPE,
+    JSON_UNICODE,
+    JSON_BARE, // numbers, true, false and null
+} JsonState;
+
+// incremental parser for the output of `exiftool -j`, the bytes are fed as they arrive from the pipe
+// depth 1 is the array, depth 2 the object of a file and depth 3 a list value (only the first item is kept)
+typedef struct {
+    JsonState state;
+    int depth;
+    bool expectingKey;
+    unsigned int unicode;
+    int unicodeDigits;
+    unsigned int highSurrogate;
+
+    StringBuilder token;
+    char *key;
+    StringBuilder line; // text outside of the json, used to find the ready message
+
+    // object being parsed
+    char *sourceFile;
+    MusicTags current;
+
+    const char **filePaths;
+    int filesCount;
+    MusicTags *tags;
+    bool *found;
+
+    const char *readyMessage;
+    bool ready;
+} ExiftoolParser;
+
+static struct {
+    pid_t pid;
+    int input;  // stdin of exiftool
+    int output; // stdout of exiftool
+    int executeId;
+    bool unavailable; // the process died before answering anything, we don't try again
+    pthread_mutex_t lock;
+} exiftool = {
+    .input = -1,
+    .output = -1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static bool exiftool_spawn(void) {
+    int inputPipe[2];
+    int outputPipe[2];
+
+    if(pipe(inputPipe) != 0) return false;
+    if(pipe(outputPipe) != 0) {
+        close(inputPipe[0]);
+        close(inputPipe[1]);
+        return false;
+    }
+
+    pid_t pid = fork();
+
+    if(pid < 0) {
+        close(inputPipe[0]);
+        close(inputPipe[1]);
+        close(outputPipe[0]);
+        close(outputPipe[1]);
+        return false;
+    }
+
+    if(pid == 0) {
+        dup2(inputPipe[0], STDIN_FILENO);
+        dup2(outputPipe[1], STDOUT_FILENO);
+
+        int devNull = open("/dev/null", O_WRONLY);
+        if(devNull >= 0) dup2(devNull, STDERR_FILENO);
+
+        close(inputPipe[0]);
+        close(inputPipe[1]);
+        close(outputPipe[0]);
+        close(outputPipe[1]);
+
+        execlp("exiftool", "exiftool", "-stay_open", "True", "-@", "-", NULL);
+        _exit(127);
+    }
+
+    close(inputPipe[0]);
+    close(outputPipe[1]);
+
+    // writing to the pipe after exiftool died would kill us otherwise
+    signal(SIGPIPE, SIG_IGN);
+
+    exiftool.pid = pid;
+    exiftool.input = inputPipe[1];
+    exiftool.output = outputPipe[0];
+    return true;
+}
+
+static void exiftool_close(void) {
+    if(exiftool.input >= 0) close(exiftool.input);
+    if(exiftool.output >= 0) close(exiftool.output);
+    if(exiftool.pid > 0) waitpid(exiftool.pid, NULL, 0);
+
+    exiftool.pid = 0;
+    exiftool.input = -1;
+    exiftool.output = -1;
+}
+
+static bool write_all(int fd, const char *data, size_t size) {
+    while(size > 0) {
+        ssize_t written = write(fd, data, size);
+        if(written < 0 && errno == EINTR) continue;
+        if(written <= 0) return false;
+
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+static void parser_set_str(char **dst, char *value) {
+    if(*dst == NULL) {
+        *dst = value;
+    } else {
+        free(value);
+    }
+}
+
+static void parser_set_picture(ExiftoolParser *parser, char *value) {
+    size_t prefixSize = sizeof(EXIFTOOL_PICTURE_PREFIX) - 1;
+    MusicTags *tags = &parser->current;
+
+    if(tags->data == NULL && strncmp(value, EXIFTOOL_PICTURE_PREFIX, prefixSize) == 0) {
+        size_t size;
+        unsigned char *data = base64_decode((unsigned char*)value + prefixSize, strlen(value) - prefixSize, &size);
+        const char *type = data == NULL ? NULL : get_picture_file_type(data, size);
+
+        if(type != NULL) {
+            tags->data = data;
+            tags->cover = data;
+            tags->coverSize = size;
+            tags->coverType = type;
+        } else {
+            free(data);
+        }
+    }
+
+    free(value);
+}
+
+static void parser_token_end(ExiftoolParser *parser) {
+    char *value = sb_dump_str(&parser->token);
+    parser->token.count = 0;
+
+    if(parser->depth == 2 && parser->expectingKey) {
+        free(parser->key);
+        parser->key = value;
+        return;
+    }
+
+    if(parser->depth < 2 || parser->key == NULL) {
+        free(value);
+        return;
+    }
+
+    MusicTags *tags = &parser->current;
+    const char *key = parser->key;
+
+    if(strcmp(key, "SourceFile") == 0) parser_set_str(&parser->sourceFile, value);
+    else if(strcmp(key, "Title") == 0) parser_set_str(&tags->title, value);
+    else if(strcmp(key, "Artist") == 0) parser_set_str(&tags->artist, value);
+    else if(strcmp(key, "Genre") == 0) parser_set_str(&tags->genre, value);
+    else if(strcmp(key, "Album") == 0) parser_set_str(&tags->album, value);
+    else if(strcmp(key, "Picture") == 0) parser_set_picture(parser, value);
+    else free(value);
+}
+
+// moves the parsed tags to the entry of the requested file with the same path
+static void parser_object_end(ExiftoolParser *parser) {
+    MusicTags *tags = &parser->current;
+    int index = -1;
+
+    for(int i = 0; parser->sourceFile != NULL && i < parser->filesCount; i++) {
+        if(!parser->found[i] && strcmp(parser->filePaths[i], parser->sourceFile) == 0) {
+            index = i;
+            break;
+        }
+    }
+
+    if(index >= 0) {
+        if(tags->title == NULL) tags->title = strdup("");
+        if(tags->artist == NULL) tags->artist = strdup("");
+        if(tags->genre == NULL) tags->genre = strdup("");
+        if(tags->album == NULL) tags->album = strdup("");
+
+        parser->tags[index] = *tags;
+        parser->found[index] = true;
+        memset(tags, 0, sizeof(MusicTags));
+    } else {
+        unload_music_tags(tags);
+    }
+
+    free(parser->sourceFile);
+    parser->sourceFile = NULL;
+    free(parser->key);
+    parser->key = NULL;
+}
+
+static void parser_feed_default(ExiftoolParser *parser, char c) {
+    // outside of the json we only look for the ready message
+    if(parser->depth == 0) {
+        if(c == '[') {
+            parser->depth++;
+        } else if(c == '\n') {
+            da_append(&parser->line, '\0');
+            if(strcmp(parser->line.items, parser->readyMessage) == 0) parser->ready = true;
+            parser->line.count = 0;
+        } else if(c != '\r') {
+            da_append(&parser->line, c);
+        }
+        return;
+    }
+
+    switch(c) {
+        case '[':
+        case '{':
+            parser->depth++;
+            if(parser->depth == 2) parser->expectingKey = true;
+            break;
+        case '}':
+            if(parser->depth == 2) parser_object_end(parser);
+            parser->depth--;
+            break;
+        case ']':
+            parser->depth--;
+            break;
+        case ':':
+            parser->expectingKey = false;
+            break;
+        case ',':
+            if(parser->depth == 2) parser->expectingKey = true;
+            break;
+        case '"':
+            parser->state = JSON_STRING;
+            break;
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            break;
+        default:
+            parser->state = JSON_BARE;
+            da_append(&parser->token, c);
+            break;
+    }
+}
+
+static void parser_append_codepoint(ExiftoolParser *parser, unsigned int codepoint) {
+    if(codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+        parser->highSurrogate = codepoint;
+        return;
+    }
+
+    if(codepoint >= 0xDC00 && codepoint <= 0xDFFF && parser->highSurrogate != 0) {
+        codepoint = 0x10000 + ((parser->highSurrogate - 0xD800) << 10) + (codepoint - 0xDC00);
+    }
+
+    parser->highSurrogate = 0;
+    sb_append_utf8(&parser->token, codepoint);
+}
+
+static void parser_feed(ExiftoolParser *parser, char c) {
+    switch(parser->state) {
+        case JSON_DEFAULT:
+            parser_feed_default(parser, c);
+            break;
+        case JSON_STRING:
+            if(c == '\\') {
+                parser->state = JSON_ESCAPE;
+            } else if(c == '"') {
+                parser->state = JSON_DEFAULT;
+                parser_token_end(parser);
+            } else {
+                da_append(&parser->token, c);
+            }
+            break;
+        case JSON_ESCAPE:
+            parser->state = JSON_STRING;
+            switch(c) {
+                case 'b': da_append(&parser->token, '\b'); break;
+                case 'f': da_append(&parser->token, '\f'); break;
+                case 'n': da_append(&parser->token, '\n'); break;
+                case 'r': da_append(&parser->token, '\r'); break;
+                case 't': da_append(&parser->token, '\t'); break;
+                case 'u':
+                    parser->state = JSON_UNICODE;
+                    parser->unicode = 0;
+                    parser->unicodeDigits = 0;
+                    break;
+                default: da_append(&parser->token, c); break;
+            }
+            break;
+        case JSON_UNICODE: {
+            int digit = 0;
+            if(c >= '0' && c <= '9') digit = c - '0';
+            else if(c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+            else if(c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+
+            parser->unicode = parser->unicode << 4 | digit;
+            if(++parser->unicodeDigits == 4) {
+                parser->state = JSON_STRING;
+                parser_append_codepoint(parser, parser->unicode);
+            }
+        } break;
+        case JSON_BARE:
+            if(c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+                parser->state = JSON_DEFAULT;
+                parser_token_end(parser);
+                parser_feed_default(parser, c);
+            } else {
+                da_append(&parser->token, c);
+            }
+            break;
+    }
+}
+
+static void parser_free(ExiftoolParser *parser) {
+    unload_music_tags(&parser->current);
+    free(parser->sourceFile);
+    free(parser->key);
+    da_free(&parser->token);
+    da_free(&parser->line);
+}
+
+// sends the request and parses the answer until the ready message arrives
+static bool exiftool_execute(const char *request, ExiftoolParser *parser) {
+    if(!write_all(exiftool.input, request, strlen(request))) return false;
+
+    char buffer[EXIFTOOL_READ_CHUNK];
+
+    while(!parser->ready) {
+        ssize_t count = read(exiftool.output, buffer, sizeof(buffer));
+        if(count < 0 && errno == EINTR) continue;
+        if(count <= 0) return false;
+
+        for(ssize_t i = 0; i < count; i++) {
+            parser_feed(parser, buffer[i]);
+        }
+    }
+
+    return true;
+}
+
+bool exiftool_read_tags(const char **filePaths, int filesCount, MusicTags *tags, bool *found) {
+    memset(tags, 0, sizeof(MusicTags) * filesCount);
+    memset(found, 0, sizeof(bool) * filesCount);
+
+    pthread_mutex_lock(&exiftool.lock);
+
+    if(exiftool.unavailable || (exiftool.pid == 0 && !exiftool_spawn())) {
+        pthread_mutex_unlock(&exiftool.lock);
+        return false;
+    }
+
+    int executeId = ++exiftool.executeId;
+
+    // every line of the request is an argument
+    StringBuilder request = {0};
+    const char *options = "-j\n-b\n-Title\n-Artist\n-Genre\n-Album\n-Picture\n";
+    da_append_many(&request, options, strlen(options));
+
+    for(int i = 0; i < filesCount; i++) {
+        // paths with new lines can't be passed as arguments
+        if(strchr(filePaths[i], '\n') != NULL) continue;
+        da_append_many(&request, filePaths[i], strlen(filePaths[i]));
+        da_append(&request, '\n');
+    }
+
+    char execute[32];
+    snprintf(execute, sizeof(execute), "-execute%d\n", executeId);
+    da_append_many(&request, execute, strlen(execute));
+    da_append(&request, '\0');
+
+    char readyMessage[32];
+    snprintf(readyMessage, sizeof(readyMessage), "{ready%d}", executeId);
+
+    ExiftoolParser parser = {
+        .filePaths = filePaths,
+        .filesCount = filesCount,
+        .tags = tags,
+        .found = found,
+        .readyMessage = readyMessage,
+    };
+
+    bool ok = exiftool_execute(request.items, &parser);
+
+    if(!ok) {
+        log_error("The exiftool process died (pid %d)", exiftool.pid);
+        if(executeId == 1) exiftool.unavailable = true;
+        exiftool_close();
+    }
+
+    parser_free(&parser);
+    da_free(&request);
+
+    pthread_mutex_unlock(&exiftool.lock);
+    return ok;
+}
+
+void exiftool_stop(void) {
+    pthread_mutex_lock(&exiftool.lock);
+
+    if(exiftool.pid > 0) {
+        const char *stop = "-stay_open\nFalse\n";
+        write_all(exiftool.input, stop, strlen(stop));
+        exiftool_close();
+    }
+
+    pthread_mutex_unlock(&exiftool.lock);
+}
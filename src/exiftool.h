@@ -0,0 +1,19 @@
+#ifndef EXIFTOOL_H
+#define EXIFTOOL_H
+
+#include <stdbool.h>
+
+#include "tags.h"
+
+// Long lived `exiftool -stay_open True -@ -` process used for the formats that tags.c can't read.
+// It's started on the first request and shared by every thread, the requests are serialized.
+
+// reads title, artist, genre, album and picture of many files in one round trip
+// `tags` needs room for `filesCount` entries, `found[i]` tells if exiftool returned something for the file
+// returns false when the process couldn't be started or died
+bool exiftool_read_tags(const char **filePaths, int filesCount, MusicTags *tags, bool *found);
+
+// asks the process to exit and waits for it
+void exiftool_stop(void);
+
+#endif // EXIFTOOL_H
@@ -0,0 +1,66 @@
+#include <string.h>
+
+#include "fuzzy.h"
+
+// words of 1 to 3 bytes have to match exactly, up to 6 can have one error
+static int get_max_errors(int length) {
+    if(length < 4) return 0;
+    if(length < 7) return 1;
+    return 2;
+}
+
+void fuzzy_compile(FuzzyPattern *pattern, const char *word, size_t length) {
+    if(length > FUZZY_MAX_LENGTH) length = FUZZY_MAX_LENGTH;
+
+    memset(pattern->peq, 0, sizeof(pattern->peq));
+    for(size_t i = 0; i < length; i++) pattern->peq[(unsigned char)word[i]] |= 1ULL << i;
+
+    pattern->signature = fuzzy_signature(word, length);
+    pattern->length = length;
+    pattern->maxErrors = get_max_errors(length);
+}
+
+uint64_t fuzzy_signature(const char *text, size_t length) {
+    uint64_t signature = 0;
+    for(size_t i = 0; i < length; i++) signature |= 1ULL << ((unsigned char)text[i] % 64);
+    return signature;
+}
+
+// Hyyrö's version of Myers' algorithm, pv/mv are the +1/-1 vertical deltas of the column of the dp
+// matrix and score is its last cell. The top row stays at 0 so a match can start anywhere in the text.
+int fuzzy_match(const FuzzyPattern *pattern, const char *text, size_t *end) {
+    if(pattern->length == 0) {
+        *end = 0;
+        return 0;
+    }
+
+    uint64_t last = 1ULL << (pattern->length - 1);
+    uint64_t pv = pattern->length == 64 ? ~0ULL : (last << 1) - 1;
+    uint64_t mv = 0;
+    int score = pattern->length;
+    int best = -1;
+
+    for(size_t i = 0; text[i] != '\0'; i++) {
+        uint64_t eq = pattern->peq[(unsigned char)text[i]];
+        uint64_t xv = eq | mv;
+        uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+
+        if(ph & last) score++;
+        else if(mh & last) score--;
+
+        ph <<= 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+
+        if(score <= pattern->maxErrors && (best < 0 || score < best)) {
+            best = score;
+            *end = i + 1;
+            if(best == 0) break;
+        }
+    }
+
+    return best;
+}
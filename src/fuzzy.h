@@ -0,0 +1,37 @@
+#ifndef FUZZY_H
+#define FUZZY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Approximate matching of a word inside a text with Myers' bit-parallel edit distance: every pattern
+// position is a bit of a 64 bit word, so a text byte costs a few integer operations whatever the word
+// length. The distance is to the best substring of the text (insertions, deletions and substitutions
+// of bytes), "beyonse" is at 1 from "beyonce knowles".
+
+#define FUZZY_MAX_LENGTH 64 // longer words are cut
+
+typedef struct {
+    uint64_t peq[256]; // bit i is set in the entry of the byte at position i of the word
+    uint64_t signature; // see fuzzy_signature
+    int length;
+    int maxErrors;
+} FuzzyPattern;
+
+// the number of errors allowed grows with the length of the word
+void fuzzy_compile(FuzzyPattern *pattern, const char *word, size_t length);
+
+// bit (byte % 64) is set for every byte of the text, it rejects most texts before fuzzy_match
+uint64_t fuzzy_signature(const char *text, size_t length);
+
+// every byte of the word that isn't in the text is at least one error
+static inline bool fuzzy_may_match(const FuzzyPattern *pattern, uint64_t textSignature) {
+    return __builtin_popcountll(pattern->signature & ~textSignature) <= pattern->maxErrors;
+}
+
+// returns the lowest distance or -1 when it's above maxErrors, end is set to the byte after the first
+// substring at that distance
+int fuzzy_match(const FuzzyPattern *pattern, const char *text, size_t *end);
+
+#endif // FUZZY_H
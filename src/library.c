@@ -0,0 +1,1017 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "CCFuncs.h"
+#include "raylib.h"
+#include "library.h"
+#include "tags.h"
+#include "exiftool.h"
+#include "snapshot.h"
+#include "pool.h"
+#include "search.h"
+#include "collate.h"
+
+#define LIBRARY_MAX_WORKERS 16
+// the walker waits when this many files are waiting for a worker, so a huge tree doesn't fill the memory
+#define LIBRARY_QUEUE_SIZE 1024
+// files that tags.c can't read are sent to exiftool in groups of this size
+#define LIBRARY_EXIFTOOL_BATCH 32
+
+static const char *musicExtensions[] = {".mp3", ".flac", ".ogg", ".opus", ".wav", ".qoa"};
+
+typedef struct {
+    char **items;
+    size_t count;
+    size_t capacity;
+} PathList;
+
+// track read by a worker, its strings are moved to the pool once it's added
+typedef struct {
+    char *filePath;
+    char *title;
+    char *artist;
+    char *album;
+    char *genre;
+    char *titleKey;
+    char *artistKey;
+    char *albumKey;
+    char *nameKey;
+    float duration;
+    uint32_t coverHash;
+    int64_t modTime;
+    int64_t fileSize;
+} ScannedTrack;
+
+static struct {
+    pthread_mutex_t lock; // protects the tracks and the progress
+    LibraryTable tracks;
+    // the strings replaced by a rescan stay in the pool until the snapshot is written
+    StringPool strings;
+    uint32_t nextId;
+
+    // open addressing table from the path to the index in tracks, SIZE_MAX is an empty slot
+    // after loading a snapshot it's built by the first lookup, the same goes for the interned strings
+    struct {
+        size_t *items;
+        size_t capacity;
+    } index;
+    bool indexStale;
+    bool internedStale;
+    bool searchStale; // the tracks of a loaded snapshot aren't in the search index yet
+
+    // position of every track in the order of each collation key, computed by library_sort after a change
+    struct {
+        uint32_t *title;
+        uint32_t *artist;
+        uint32_t *album;
+        uint32_t *name;
+        size_t capacity;
+    } ranks;
+    bool ranksStale;
+    unsigned long version; // incremented by every change of the tracks
+
+    size_t filesFound;
+    size_t filesScanned;
+    uint32_t generation; // incremented for every walk, see LibraryTable.seen
+    Snapshot snapshot;
+
+    pthread_mutex_t scanLock; // protects everything below
+    pthread_cond_t rootsCond;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+    bool running;
+    bool quit;
+
+    PathList roots; // directories waiting for the walker
+    bool walking;
+
+    // files waiting for a worker, it's a ring buffer of LIBRARY_QUEUE_SIZE
+    char *queue[LIBRARY_QUEUE_SIZE];
+    size_t queueStart;
+    size_t queueCount;
+    size_t pending; // files queued or being read by a worker
+
+    pthread_t walker;
+    pthread_t workers[LIBRARY_MAX_WORKERS];
+    int workersCount;
+} library = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .scanLock = PTHREAD_MUTEX_INITIALIZER,
+    .rootsCond = PTHREAD_COND_INITIALIZER,
+    .notEmpty = PTHREAD_COND_INITIALIZER,
+    .notFull = PTHREAD_COND_INITIALIZER,
+};
+
+bool is_music_file(const char *filePath) {
+    const char *ext = strrchr(filePath, '.');
+    if(ext == NULL || strchr(ext, '/') != NULL) return false;
+
+    for(size_t i = 0; i < sizeof(musicExtensions) / sizeof(musicExtensions[0]); i++) {
+        if(strcasecmp(ext, musicExtensions[i]) == 0) return true;
+    }
+
+    return false;
+}
+
+// FNV-1a
+static uint64_t hash_path(const char *filePath) {
+    uint64_t hash = 14695981039346656037ULL;
+    for(const unsigned char *c = (const unsigned char*)filePath; *c != '\0'; c++) {
+        hash = (hash ^ *c) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// returns the slot of the path or the empty slot where it should go, the lock has to be held
+static size_t find_index_slot(const char *filePath) {
+    size_t mask = library.index.capacity - 1;
+    size_t slot = hash_path(filePath) & mask;
+
+    while(library.index.items[slot] != SIZE_MAX) {
+        uint32_t pathId = library.tracks.filePath[library.index.items[slot]];
+        if(strcmp(pool_get(&library.strings, pathId), filePath) == 0) break;
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+// the lock has to be held
+static void rebuild_index(size_t capacity) {
+    free(library.index.items);
+    library.index.items = malloc(capacity * sizeof(size_t));
+    library.index.capacity = capacity;
+    memset(library.index.items, 0xFF, capacity * sizeof(size_t));
+
+    for(size_t i = 0; i < library.tracks.count; i++) {
+        library.index.items[find_index_slot(pool_get(&library.strings, library.tracks.filePath[i]))] = i;
+    }
+
+    library.indexStale = false;
+}
+
+// keeps the table at most half full, the lock has to be held
+static void grow_index(void) {
+    size_t capacity = library.index.capacity == 0 ? 256 : library.index.capacity;
+    while((library.tracks.count + 1) * 2 > capacity) capacity *= 2;
+
+    if(capacity != library.index.capacity || library.indexStale) rebuild_index(capacity);
+}
+
+// the strings of a snapshot are registered when the first track is added, the lock has to be held
+static void register_interned(void) {
+    for(size_t i = 0; i < library.tracks.count; i++) {
+        pool_register(&library.strings, library.tracks.artist[i]);
+        pool_register(&library.strings, library.tracks.album[i]);
+        pool_register(&library.strings, library.tracks.genre[i]);
+        pool_register(&library.strings, library.tracks.artistKey[i]);
+        pool_register(&library.strings, library.tracks.albumKey[i]);
+    }
+
+    library.internedStale = false;
+}
+
+static void reserve_tracks(size_t count) {
+    LibraryTable *tracks = &library.tracks;
+    if(count <= tracks->capacity) return;
+
+    size_t capacity = tracks->capacity == 0 ? 256 : tracks->capacity;
+    while(capacity < count) capacity *= 2;
+
+    tracks->id = realloc(tracks->id, capacity * sizeof(*tracks->id));
+    tracks->filePath = realloc(tracks->filePath, capacity * sizeof(*tracks->filePath));
+    tracks->title = realloc(tracks->title, capacity * sizeof(*tracks->title));
+    tracks->artist = realloc(tracks->artist, capacity * sizeof(*tracks->artist));
+    tracks->album = realloc(tracks->album, capacity * sizeof(*tracks->album));
+    tracks->genre = realloc(tracks->genre, capacity * sizeof(*tracks->genre));
+    tracks->titleKey = realloc(tracks->titleKey, capacity * sizeof(*tracks->titleKey));
+    tracks->artistKey = realloc(tracks->artistKey, capacity * sizeof(*tracks->artistKey));
+    tracks->albumKey = realloc(tracks->albumKey, capacity * sizeof(*tracks->albumKey));
+    tracks->nameKey = realloc(tracks->nameKey, capacity * sizeof(*tracks->nameKey));
+    tracks->duration = realloc(tracks->duration, capacity * sizeof(*tracks->duration));
+    tracks->coverHash = realloc(tracks->coverHash, capacity * sizeof(*tracks->coverHash));
+    tracks->modTime = realloc(tracks->modTime, capacity * sizeof(*tracks->modTime));
+    tracks->fileSize = realloc(tracks->fileSize, capacity * sizeof(*tracks->fileSize));
+    tracks->seen = realloc(tracks->seen, capacity * sizeof(*tracks->seen));
+    tracks->capacity = capacity;
+}
+
+static void free_tracks(void) {
+    LibraryTable *tracks = &library.tracks;
+    free(tracks->id);
+    free(tracks->filePath);
+    free(tracks->title);
+    free(tracks->artist);
+    free(tracks->album);
+    free(tracks->genre);
+    free(tracks->titleKey);
+    free(tracks->artistKey);
+    free(tracks->albumKey);
+    free(tracks->nameKey);
+    free(tracks->duration);
+    free(tracks->coverHash);
+    free(tracks->modTime);
+    free(tracks->fileSize);
+    free(tracks->seen);
+    memset(tracks, 0, sizeof(LibraryTable));
+}
+
+static void move_track(size_t dst, size_t src) {
+    LibraryTable *tracks = &library.tracks;
+    tracks->id[dst] = tracks->id[src];
+    tracks->filePath[dst] = tracks->filePath[src];
+    tracks->title[dst] = tracks->title[src];
+    tracks->artist[dst] = tracks->artist[src];
+    tracks->album[dst] = tracks->album[src];
+    tracks->genre[dst] = tracks->genre[src];
+    tracks->titleKey[dst] = tracks->titleKey[src];
+    tracks->artistKey[dst] = tracks->artistKey[src];
+    tracks->albumKey[dst] = tracks->albumKey[src];
+    tracks->nameKey[dst] = tracks->nameKey[src];
+    tracks->duration[dst] = tracks->duration[src];
+    tracks->coverHash[dst] = tracks->coverHash[src];
+    tracks->modTime[dst] = tracks->modTime[src];
+    tracks->fileSize[dst] = tracks->fileSize[src];
+    tracks->seen[dst] = tracks->seen[src];
+}
+
+static void free_scanned_track(ScannedTrack *track) {
+    free(track->filePath);
+    free(track->title);
+    free(track->artist);
+    free(track->album);
+    free(track->genre);
+    free(track->titleKey);
+    free(track->artistKey);
+    free(track->albumKey);
+    free(track->nameKey);
+}
+
+// the strings are copied into the pool, if the file was already there its entry is replaced and keeps its id
+static void add_library_track(ScannedTrack *track) {
+    pthread_mutex_lock(&library.lock);
+
+    grow_index();
+    if(library.internedStale) register_interned();
+
+    size_t slot = find_index_slot(track->filePath);
+    size_t index = library.index.items[slot];
+
+    if(index == SIZE_MAX) {
+        index = library.tracks.count++;
+        reserve_tracks(library.tracks.count);
+        library.index.items[slot] = index;
+        library.tracks.id[index] = library.nextId++;
+        library.tracks.filePath[index] = pool_add(&library.strings, track->filePath);
+    }
+
+    LibraryTable *tracks = &library.tracks;
+    tracks->title[index] = pool_add(&library.strings, track->title);
+    tracks->artist[index] = pool_intern(&library.strings, track->artist);
+    tracks->album[index] = pool_intern(&library.strings, track->album);
+    tracks->genre[index] = pool_intern(&library.strings, track->genre);
+    tracks->titleKey[index] = pool_add(&library.strings, track->titleKey);
+    tracks->artistKey[index] = pool_intern(&library.strings, track->artistKey);
+    tracks->albumKey[index] = pool_intern(&library.strings, track->albumKey);
+    tracks->nameKey[index] = pool_add(&library.strings, track->nameKey);
+    tracks->duration[index] = track->duration;
+    tracks->coverHash[index] = track->coverHash;
+    tracks->modTime[index] = track->modTime;
+    tracks->fileSize[index] = track->fileSize;
+    tracks->seen[index] = library.generation;
+    uint32_t id = tracks->id[index];
+    library.ranksStale = true;
+    library.version++;
+
+    pthread_mutex_unlock(&library.lock);
+
+    search_index_add(id, track->title, track->artist, track->album, track->genre);
+    free_scanned_track(track);
+}
+
+// it's called from many threads so raylib's GetFileNameWithoutExt (static buffer) can't be used
+static char *get_file_title(const char *filePath) {
+    const char *name = strrchr(filePath, '/');
+    name = name == NULL ? filePath : name + 1;
+
+    const char *ext = strrchr(name, '.');
+    size_t length = ext == NULL || ext == name ? strlen(name) : (size_t)(ext - name);
+    return strndup(name, length);
+}
+
+static char *get_collation_key(const char *str) {
+    StringBuilder sb = {0};
+    make_collation_key(&sb, str);
+    return sb.items;
+}
+
+// moves the strings out of the tags, the title is the file name when it's empty
+// the keys are made here so the workers share the work
+static void make_scanned_track(ScannedTrack *track, const char *filePath, MusicTags *tags, const struct stat *st) {
+    track->filePath = strdup(filePath);
+    track->artist = tags->artist;
+    track->album = tags->album;
+    track->genre = tags->genre;
+    track->duration = tags->duration;
+    track->coverHash = tags->cover == NULL ? 0 : ComputeCRC32((unsigned char*)tags->cover, tags->coverSize);
+    track->modTime = st->st_mtime;
+    track->fileSize = st->st_size;
+
+    if(tags->title[0] != '\0') {
+        track->title = tags->title;
+    } else {
+        track->title = get_file_title(filePath);
+        free(tags->title);
+    }
+
+    char *name = get_file_title(filePath);
+    track->titleKey = get_collation_key(track->title);
+    track->artistKey = get_collation_key(track->artist);
+    track->albumKey = get_collation_key(track->album);
+    track->nameKey = get_collation_key(name);
+    free(name);
+
+    tags->title = tags->artist = tags->album = tags->genre = NULL;
+    unload_music_tags(tags);
+}
+
+// counts the file as scanned even if its tags couldn't be read
+static void finish_file(void) {
+    pthread_mutex_lock(&library.lock);
+    library.filesScanned++;
+    pthread_mutex_unlock(&library.lock);
+
+    pthread_mutex_lock(&library.scanLock);
+    library.pending--;
+    pthread_mutex_unlock(&library.scanLock);
+}
+
+static void scan_with_exiftool(PathList *batch) {
+    MusicTags tags[LIBRARY_EXIFTOOL_BATCH];
+    bool found[LIBRARY_EXIFTOOL_BATCH];
+
+    if(!exiftool_read_tags((const char**)batch->items, batch->count, tags, found)) {
+        memset(found, 0, sizeof(found));
+    }
+
+    for(size_t i = 0; i < batch->count; i++) {
+        struct stat st;
+
+        if(!found[i]) {
+            log_error("Failed to read the tags from %s", batch->items[i]);
+        } else if(stat(batch->items[i], &st) != 0) {
+            unload_music_tags(&tags[i]);
+        } else {
+            ScannedTrack track = {0};
+            make_scanned_track(&track, batch->items[i], &tags[i], &st);
+            add_library_track(&track);
+        }
+
+        free(batch->items[i]);
+        finish_file();
+    }
+
+    batch->count = 0;
+}
+
+// returns false when the file has to be read by exiftool
+static bool scan_file(const char *filePath) {
+    struct stat st;
+    if(stat(filePath, &st) != 0) {
+        log_error("Failed to stat %s", filePath);
+        return true;
+    }
+
+    MusicTags tags;
+    if(!read_music_tags(filePath, &tags)) return false;
+
+    ScannedTrack track = {0};
+    make_scanned_track(&track, filePath, &tags, &st);
+    add_library_track(&track);
+    return true;
+}
+
+static void *library_worker(void *arg) {
+    (void)arg;
+
+    PathList batch = {0};
+
+    pthread_mutex_lock(&library.scanLock);
+
+    while(true) {
+        // the batch is sent before sleeping, otherwise the last files of a scan would wait forever
+        if(library.queueCount == 0 && batch.count > 0 && !library.quit) {
+            pthread_mutex_unlock(&library.scanLock);
+            scan_with_exiftool(&batch);
+            pthread_mutex_lock(&library.scanLock);
+            continue;
+        }
+
+        while(library.queueCount == 0 && !library.quit) {
+            pthread_cond_wait(&library.notEmpty, &library.scanLock);
+        }
+
+        if(library.quit) break;
+
+        char *filePath = library.queue[library.queueStart];
+        library.queueStart = (library.queueStart + 1) % LIBRARY_QUEUE_SIZE;
+        library.queueCount--;
+        pthread_cond_signal(&library.notFull);
+
+        // the disk is read without the lock so the workers run in parallel
+        pthread_mutex_unlock(&library.scanLock);
+
+        if(scan_file(filePath)) {
+            free(filePath);
+            finish_file();
+        } else {
+            da_append(&batch, filePath);
+            if(batch.count == LIBRARY_EXIFTOOL_BATCH) scan_with_exiftool(&batch);
+        }
+
+        pthread_mutex_lock(&library.scanLock);
+    }
+
+    pthread_mutex_unlock(&library.scanLock);
+
+    for(size_t i = 0; i < batch.count; i++) free(batch.items[i]);
+    da_free(&batch);
+    return NULL;
+}
+
+// removes the tracks of the file or of the files inside the directory, with onlyUnseen the ones found by the
+// current walk are kept. The order is kept so the index is rebuilt, the lock has to be held
+static void remove_tracks_inside(const char *path, bool onlyUnseen) {
+    size_t length = strlen(path);
+    while(length > 1 && path[length - 1] == '/') length--;
+
+    size_t kept = 0;
+    for(size_t i = 0; i < library.tracks.count; i++) {
+        const char *filePath = pool_get(&library.strings, library.tracks.filePath[i]);
+        bool inside = strncmp(filePath, path, length) == 0 && (filePath[length] == '\0' || filePath[length] == '/');
+        if(inside && !(onlyUnseen && library.tracks.seen[i] == library.generation)) {
+            search_index_remove(library.tracks.id[i]);
+            continue;
+        }
+
+        if(kept != i) move_track(kept, i);
+        kept++;
+    }
+
+    if(kept != library.tracks.count) {
+        library.tracks.count = kept;
+        library.indexStale = true;
+        library.ranksStale = true;
+        library.version++;
+    }
+}
+
+// marks the file as found by the current walk, returns true when its entry is still up to date
+static bool check_library_track(const char *filePath, const struct stat *st) {
+    bool current = false;
+
+    pthread_mutex_lock(&library.lock);
+
+    grow_index();
+    size_t index = library.index.items[find_index_slot(filePath)];
+
+    if(index != SIZE_MAX) {
+        library.tracks.seen[index] = library.generation;
+        current = library.tracks.modTime[index] == st->st_mtime && library.tracks.fileSize[index] == st->st_size;
+    }
+
+    if(current) {
+        library.filesFound++;
+        library.filesScanned++;
+    }
+
+    pthread_mutex_unlock(&library.lock);
+    return current;
+}
+
+// waits for room in the queue, returns false when the library is closing
+static bool queue_file(char *filePath) {
+    pthread_mutex_lock(&library.scanLock);
+
+    while(library.queueCount == LIBRARY_QUEUE_SIZE && !library.quit) {
+        pthread_cond_wait(&library.notFull, &library.scanLock);
+    }
+
+    bool quit = library.quit;
+    if(!quit) {
+        library.queue[(library.queueStart + library.queueCount) % LIBRARY_QUEUE_SIZE] = filePath;
+        library.queueCount++;
+        library.pending++;
+        pthread_cond_signal(&library.notEmpty);
+    }
+
+    pthread_mutex_unlock(&library.scanLock);
+
+    if(quit) {
+        free(filePath);
+        return false;
+    }
+
+    pthread_mutex_lock(&library.lock);
+    library.filesFound++;
+    pthread_mutex_unlock(&library.lock);
+    return true;
+}
+
+// iterative so a deep tree can't overflow the stack, symlinks to directories aren't followed to avoid loops
+static void walk_directory(const char *rootPath) {
+    pthread_mutex_lock(&library.lock);
+    library.generation++;
+    pthread_mutex_unlock(&library.lock);
+
+    PathList dirs = {0};
+    da_append(&dirs, strdup(rootPath));
+    bool quit = false;
+
+    while(dirs.count > 0) {
+        char *dirPath = dirs.items[--dirs.count];
+        DIR *dir = opendir(dirPath);
+
+        if(dir == NULL) {
+            log_error("Failed to open the directory %s", dirPath);
+            free(dirPath);
+            continue;
+        }
+
+        struct dirent *entry;
+        while((entry = readdir(dir)) != NULL) {
+            if(entry->d_name[0] == '.') continue; // ".", ".." and hidden files
+
+            StringBuilder sb = {0};
+            da_append_many(&sb, dirPath, strlen(dirPath));
+            if(sb.count == 0 || sb.items[sb.count - 1] != '/') da_append(&sb, '/');
+            da_append_many(&sb, entry->d_name, strlen(entry->d_name));
+            char *path = sb_dump_str(&sb);
+            da_free(&sb);
+
+            bool isDir = entry->d_type == DT_DIR;
+            bool isFile = false;
+
+            // the files are stat'ed here to skip the ones that didn't change since the snapshot
+            struct stat st;
+            if(entry->d_type == DT_UNKNOWN && lstat(path, &st) == 0) {
+                isDir = S_ISDIR(st.st_mode);
+            }
+
+            if(!isDir && is_music_file(path) && stat(path, &st) == 0) {
+                isFile = S_ISREG(st.st_mode);
+            }
+
+            if(isDir) {
+                da_append(&dirs, path);
+            } else if(isFile && !check_library_track(path, &st)) {
+                if(!queue_file(path)) break;
+            } else {
+                free(path);
+            }
+        }
+
+        closedir(dir);
+        free(dirPath);
+
+        pthread_mutex_lock(&library.scanLock);
+        quit = library.quit;
+        pthread_mutex_unlock(&library.scanLock);
+        if(quit) break;
+    }
+
+    bool complete = dirs.count == 0 && !quit;
+    for(size_t i = 0; i < dirs.count; i++) free(dirs.items[i]);
+    da_free(&dirs);
+
+    // the files that weren't found anymore are removed, a walk stopped halfway can't tell which ones
+    if(complete) {
+        pthread_mutex_lock(&library.lock);
+        remove_tracks_inside(rootPath, true);
+        pthread_mutex_unlock(&library.lock);
+    }
+}
+
+// the tracks of a snapshot are indexed here so the startup doesn't wait for it. Their strings are read
+// from the mapping, which stays until library_close, the ones changed since the load were indexed when added
+static void index_snapshot_tracks(void) {
+    pthread_mutex_lock(&library.lock);
+
+    if(!library.searchStale) {
+        pthread_mutex_unlock(&library.lock);
+        return;
+    }
+
+    library.searchStale = false;
+    size_t count = library.tracks.count;
+    LibraryTable *tracks = &library.tracks;
+    uint32_t *ids = malloc(count * 5 * sizeof(uint32_t));
+    memcpy(ids, tracks->id, count * sizeof(uint32_t));
+    memcpy(ids + count, tracks->title, count * sizeof(uint32_t));
+    memcpy(ids + count * 2, tracks->artist, count * sizeof(uint32_t));
+    memcpy(ids + count * 3, tracks->album, count * sizeof(uint32_t));
+    memcpy(ids + count * 4, tracks->genre, count * sizeof(uint32_t));
+    const char *strings = library.snapshot.columns.strings;
+    size_t stringsSize = library.snapshot.columns.stringsSize;
+
+    pthread_mutex_unlock(&library.lock);
+
+    for(size_t i = 0; i < count; i++) {
+        uint32_t title = ids[count + i], artist = ids[count * 2 + i];
+        uint32_t album = ids[count * 3 + i], genre = ids[count * 4 + i];
+        if(title >= stringsSize || artist >= stringsSize || album >= stringsSize || genre >= stringsSize) continue;
+
+        search_index_add(ids[i], strings + title, strings + artist, strings + album, strings + genre);
+    }
+
+    free(ids);
+}
+
+static void *library_walker(void *arg) {
+    (void)arg;
+
+    index_snapshot_tracks();
+
+    pthread_mutex_lock(&library.scanLock);
+
+    while(true) {
+        while(library.roots.count == 0 && !library.quit) {
+            pthread_cond_wait(&library.rootsCond, &library.scanLock);
+        }
+
+        if(library.quit) break;
+
+        char *rootPath = library.roots.items[0];
+        library.roots.count--;
+        memmove(library.roots.items, library.roots.items + 1, library.roots.count * sizeof(char*));
+        library.walking = true;
+
+        pthread_mutex_unlock(&library.scanLock);
+        walk_directory(rootPath);
+        free(rootPath);
+        pthread_mutex_lock(&library.scanLock);
+
+        library.walking = false;
+    }
+
+    pthread_mutex_unlock(&library.scanLock);
+    return NULL;
+}
+
+void library_init(void) {
+    library.quit = false;
+
+    pthread_mutex_lock(&library.lock);
+    if(library.strings.base == NULL && library.strings.arena.count == 0) pool_init(&library.strings, NULL, 0);
+    pthread_mutex_unlock(&library.lock);
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int workersCount = cores < 1 ? 1 : cores > LIBRARY_MAX_WORKERS ? LIBRARY_MAX_WORKERS : cores;
+
+    if(pthread_create(&library.walker, NULL, library_walker, NULL) != 0) {
+        log_error("Failed to start the library walker (%s)", "pthread_create");
+        return;
+    }
+
+    library.running = true;
+
+    for(int i = 0; i < workersCount; i++) {
+        if(pthread_create(&library.workers[library.workersCount], NULL, library_worker, NULL) != 0) {
+            log_error("Failed to start a library worker (%s)", "pthread_create");
+            break;
+        }
+
+        library.workersCount++;
+    }
+}
+
+void library_close(void) {
+    if(!library.running) return;
+
+    pthread_mutex_lock(&library.scanLock);
+    library.quit = true;
+    pthread_cond_broadcast(&library.rootsCond);
+    pthread_cond_broadcast(&library.notEmpty);
+    pthread_cond_broadcast(&library.notFull);
+    pthread_mutex_unlock(&library.scanLock);
+
+    pthread_join(library.walker, NULL);
+    for(int i = 0; i < library.workersCount; i++) pthread_join(library.workers[i], NULL);
+    library.running = false;
+    library.workersCount = 0;
+
+    for(size_t i = 0; i < library.roots.count; i++) free(library.roots.items[i]);
+    for(size_t i = 0; i < library.queueCount; i++) {
+        free(library.queue[(library.queueStart + i) % LIBRARY_QUEUE_SIZE]);
+    }
+    da_free(&library.roots);
+    memset(&library.roots, 0, sizeof(library.roots));
+    library.queueStart = library.queueCount = library.pending = 0;
+
+    free_tracks();
+    pool_free(&library.strings);
+    free(library.index.items);
+    free(library.ranks.title);
+    free(library.ranks.artist);
+    free(library.ranks.album);
+    free(library.ranks.name);
+    memset(&library.ranks, 0, sizeof(library.ranks));
+    close_snapshot(&library.snapshot);
+    search_index_clear();
+    memset(&library.index, 0, sizeof(library.index));
+    library.nextId = 0;
+    library.filesFound = library.filesScanned = 0;
+}
+
+void library_scan(const char *rootPath) {
+    pthread_mutex_lock(&library.scanLock);
+    da_append(&library.roots, strdup(rootPath));
+    pthread_cond_signal(&library.rootsCond);
+    pthread_mutex_unlock(&library.scanLock);
+}
+
+void library_scan_file(const char *filePath) {
+    queue_file(strdup(filePath));
+}
+
+void library_remove(const char *path) {
+    pthread_mutex_lock(&library.lock);
+    remove_tracks_inside(path, false);
+    pthread_mutex_unlock(&library.lock);
+}
+
+// the columns are copied (a few MB for 100k tracks), the strings stay in the mapping as the base of the pool
+bool library_load_snapshot(const char *filePath) {
+    Snapshot snapshot;
+    if(!open_snapshot(filePath, &snapshot)) return false;
+
+    const SnapshotColumns *columns = &snapshot.columns;
+    size_t count = columns->tracksCount;
+
+    pthread_mutex_lock(&library.lock);
+
+    free_tracks();
+    pool_free(&library.strings);
+    close_snapshot(&library.snapshot);
+    library.snapshot = snapshot;
+    pool_init(&library.strings, columns->strings, columns->stringsSize);
+
+    reserve_tracks(count);
+    LibraryTable *tracks = &library.tracks;
+    tracks->count = count;
+    memcpy(tracks->id, columns->id, count * sizeof(*tracks->id));
+    memcpy(tracks->filePath, columns->filePath, count * sizeof(*tracks->filePath));
+    memcpy(tracks->title, columns->title, count * sizeof(*tracks->title));
+    memcpy(tracks->artist, columns->artist, count * sizeof(*tracks->artist));
+    memcpy(tracks->album, columns->album, count * sizeof(*tracks->album));
+    memcpy(tracks->genre, columns->genre, count * sizeof(*tracks->genre));
+    memcpy(tracks->titleKey, columns->titleKey, count * sizeof(*tracks->titleKey));
+    memcpy(tracks->artistKey, columns->artistKey, count * sizeof(*tracks->artistKey));
+    memcpy(tracks->albumKey, columns->albumKey, count * sizeof(*tracks->albumKey));
+    memcpy(tracks->nameKey, columns->nameKey, count * sizeof(*tracks->nameKey));
+    memcpy(tracks->duration, columns->duration, count * sizeof(*tracks->duration));
+    memcpy(tracks->coverHash, columns->coverHash, count * sizeof(*tracks->coverHash));
+    memcpy(tracks->modTime, columns->modTime, count * sizeof(*tracks->modTime));
+    memcpy(tracks->fileSize, columns->fileSize, count * sizeof(*tracks->fileSize));
+    memset(tracks->seen, 0, count * sizeof(*tracks->seen));
+
+    // the ids were written in increasing order
+    library.nextId = count == 0 ? 0 : tracks->id[count - 1] + 1;
+    library.indexStale = true;
+    library.internedStale = true;
+    library.searchStale = true;
+    library.ranksStale = true;
+    library.version++;
+
+    pthread_mutex_unlock(&library.lock);
+
+    search_index_clear();
+    return true;
+}
+
+// the strings are copied to a new pool so the ones replaced or removed since the load aren't written
+bool library_save_snapshot(const char *filePath) {
+    pthread_mutex_lock(&library.lock);
+
+    LibraryTable *tracks = &library.tracks;
+    size_t count = tracks->count;
+    StringPool strings;
+    pool_init(&strings, NULL, 0);
+
+    // the string columns one after the other
+    uint32_t *stringIds = malloc((count == 0 ? 1 : count) * 9 * sizeof(uint32_t));
+    uint32_t *filePaths = stringIds;
+    uint32_t *titles = filePaths + count;
+    uint32_t *artists = titles + count;
+    uint32_t *albums = artists + count;
+    uint32_t *genres = albums + count;
+    uint32_t *titleKeys = genres + count;
+    uint32_t *artistKeys = titleKeys + count;
+    uint32_t *albumKeys = artistKeys + count;
+    uint32_t *nameKeys = albumKeys + count;
+
+    for(size_t i = 0; i < count; i++) {
+        filePaths[i] = pool_add(&strings, pool_get(&library.strings, tracks->filePath[i]));
+        titles[i] = pool_add(&strings, pool_get(&library.strings, tracks->title[i]));
+        artists[i] = pool_intern(&strings, pool_get(&library.strings, tracks->artist[i]));
+        albums[i] = pool_intern(&strings, pool_get(&library.strings, tracks->album[i]));
+        genres[i] = pool_intern(&strings, pool_get(&library.strings, tracks->genre[i]));
+        titleKeys[i] = pool_add(&strings, pool_get(&library.strings, tracks->titleKey[i]));
+        artistKeys[i] = pool_intern(&strings, pool_get(&library.strings, tracks->artistKey[i]));
+        albumKeys[i] = pool_intern(&strings, pool_get(&library.strings, tracks->albumKey[i]));
+        nameKeys[i] = pool_add(&strings, pool_get(&library.strings, tracks->nameKey[i]));
+    }
+
+    SnapshotColumns columns = {
+        .tracksCount = count,
+        .id = tracks->id,
+        .filePath = filePaths,
+        .title = titles,
+        .artist = artists,
+        .album = albums,
+        .genre = genres,
+        .titleKey = titleKeys,
+        .artistKey = artistKeys,
+        .albumKey = albumKeys,
+        .nameKey = nameKeys,
+        .duration = tracks->duration,
+        .coverHash = tracks->coverHash,
+        .modTime = tracks->modTime,
+        .fileSize = tracks->fileSize,
+        .strings = strings.arena.items,
+        .stringsSize = strings.arena.count,
+    };
+
+    bool ok = write_snapshot(filePath, &columns);
+
+    pthread_mutex_unlock(&library.lock);
+
+    free(stringIds);
+    pool_free(&strings);
+    return ok;
+}
+
+LibraryProgress library_get_progress(void) {
+    LibraryProgress progress = {0};
+
+    pthread_mutex_lock(&library.scanLock);
+    progress.scanning = library.roots.count > 0 || library.walking || library.pending > 0;
+    pthread_mutex_unlock(&library.scanLock);
+
+    pthread_mutex_lock(&library.lock);
+    progress.filesFound = library.filesFound;
+    progress.filesScanned = library.filesScanned;
+    pthread_mutex_unlock(&library.lock);
+
+    return progress;
+}
+
+void library_lock(void) {
+    pthread_mutex_lock(&library.lock);
+}
+
+void library_unlock(void) {
+    pthread_mutex_unlock(&library.lock);
+}
+
+size_t library_count(void) {
+    return library.tracks.count;
+}
+
+const LibraryTable *library_get_table(void) {
+    return &library.tracks;
+}
+
+const char *library_get_string(uint32_t id) {
+    return pool_get(&library.strings, id);
+}
+
+LibraryTrack library_get(size_t index) {
+    const LibraryTable *tracks = &library.tracks;
+
+    return (LibraryTrack){
+        .id = tracks->id[index],
+        .filePath = pool_get(&library.strings, tracks->filePath[index]),
+        .title = pool_get(&library.strings, tracks->title[index]),
+        .artist = pool_get(&library.strings, tracks->artist[index]),
+        .album = pool_get(&library.strings, tracks->album[index]),
+        .genre = pool_get(&library.strings, tracks->genre[index]),
+        .duration = tracks->duration[index],
+        .coverHash = tracks->coverHash[index],
+    };
+}
+
+unsigned long library_get_version(void) {
+    return library.version;
+}
+
+// the ids increase with the index, removing tracks doesn't change the order
+size_t library_find_id(uint32_t id) {
+    size_t low = 0;
+    size_t high = library.tracks.count;
+
+    while(low < high) {
+        size_t mid = low + (high - low) / 2;
+        if(library.tracks.id[mid] < id) low = mid + 1;
+        else high = mid;
+    }
+
+    return low < library.tracks.count && library.tracks.id[low] == id ? low : SIZE_MAX;
+}
+
+// ranks of the tracks in the order of one key column, equal keys get the same rank
+static void compute_ranks(uint32_t *ranks, const uint32_t *keyIds, uint32_t *order, const char **keys) {
+    size_t count = library.tracks.count;
+
+    for(size_t i = 0; i < count; i++) {
+        order[i] = i;
+        keys[i] = pool_get(&library.strings, keyIds[i]);
+    }
+
+    sort_by_keys(order, count, keys);
+
+    uint32_t rank = 0;
+    for(size_t i = 0; i < count; i++) {
+        if(i > 0 && keyIds[order[i]] != keyIds[order[i - 1]] && strcmp(keys[order[i]], keys[order[i - 1]]) != 0) rank++;
+        ranks[order[i]] = rank;
+    }
+}
+
+static void update_ranks(void) {
+    size_t count = library.tracks.count;
+
+    if(library.ranks.capacity < library.tracks.capacity) {
+        library.ranks.capacity = library.tracks.capacity;
+        library.ranks.title = realloc(library.ranks.title, library.ranks.capacity * sizeof(uint32_t));
+        library.ranks.artist = realloc(library.ranks.artist, library.ranks.capacity * sizeof(uint32_t));
+        library.ranks.album = realloc(library.ranks.album, library.ranks.capacity * sizeof(uint32_t));
+        library.ranks.name = realloc(library.ranks.name, library.ranks.capacity * sizeof(uint32_t));
+    }
+
+    uint32_t *order = malloc((count == 0 ? 1 : count) * sizeof(uint32_t));
+    const char **keys = malloc((count == 0 ? 1 : count) * sizeof(char*));
+
+    compute_ranks(library.ranks.title, library.tracks.titleKey, order, keys);
+    compute_ranks(library.ranks.artist, library.tracks.artistKey, order, keys);
+    compute_ranks(library.ranks.album, library.tracks.albumKey, order, keys);
+    compute_ranks(library.ranks.name, library.tracks.nameKey, order, keys);
+
+    free(order);
+    free(keys);
+    library.ranksStale = false;
+}
+
+// the ranks are below the number of tracks, 21 bits are enough for 2 million of them
+#define LIBRARY_RANK_BITS 21
+#define LIBRARY_RANK_MAX ((1u << LIBRARY_RANK_BITS) - 1)
+
+static uint64_t clamp_rank(uint32_t rank) {
+    return rank > LIBRARY_RANK_MAX ? LIBRARY_RANK_MAX : rank;
+}
+
+static uint64_t get_sort_key(size_t index, LibrarySort order) {
+    uint64_t title = clamp_rank(library.ranks.title[index]);
+    uint64_t artist = clamp_rank(library.ranks.artist[index]);
+    uint64_t album = clamp_rank(library.ranks.album[index]);
+    uint64_t name = clamp_rank(library.ranks.name[index]);
+
+    switch(order) {
+        case LIBRARY_SORT_ARTIST: return artist << (2 * LIBRARY_RANK_BITS) | album << LIBRARY_RANK_BITS | name;
+        case LIBRARY_SORT_ALBUM: return album << (2 * LIBRARY_RANK_BITS) | name << LIBRARY_RANK_BITS | title;
+        case LIBRARY_SORT_DURATION: {
+            uint64_t milliseconds = library.tracks.duration[index] * 1000.0f;
+            if(milliseconds > UINT32_MAX) milliseconds = UINT32_MAX;
+            return milliseconds << LIBRARY_RANK_BITS | title;
+        }
+        case LIBRARY_SORT_TITLE:
+        default: return title << (2 * LIBRARY_RANK_BITS) | artist << LIBRARY_RANK_BITS | album;
+    }
+}
+
+size_t library_sort(uint32_t *ids, size_t count, LibrarySort order, bool descending) {
+    if(library.ranksStale) update_ranks();
+
+    uint64_t *keys = malloc((count == 0 ? 1 : count) * sizeof(uint64_t));
+    size_t kept = 0;
+
+    for(size_t i = 0; i < count; i++) {
+        size_t index = library_find_id(ids[i]);
+        if(index == SIZE_MAX) continue;
+
+        uint64_t key = get_sort_key(index, order);
+        keys[kept] = descending ? ~key : key;
+        ids[kept] = ids[i];
+        kept++;
+    }
+
+    radix_sort_pairs(keys, ids, kept);
+
+    free(keys);
+    return kept;
+}
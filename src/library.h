@@ -0,0 +1,98 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// In-memory music library filled by a scanner: one thread walks the roots and a pool of workers (one per
+// core) reads the headers of the files it finds. The tracks are added as soon as they are read.
+
+// The tracks are stored by columns, the same index in every array is the same track. The strings are ids
+// in a single string pool (see library_get_string), artist, album and genre are interned so the tracks of
+// an album share the same ids and can be compared without strcmp.
+typedef struct {
+    size_t count;
+    size_t capacity;
+    uint32_t *id; // stable while the library is open and across snapshots, increasing with the index
+    uint32_t *filePath;
+    uint32_t *title; // never "", it's the file name when the tags don't have one
+    uint32_t *artist;
+    uint32_t *album;
+    uint32_t *genre;
+    // collation keys of the title, artist, album and file name (see collate.h), the artist and album are interned
+    uint32_t *titleKey;
+    uint32_t *artistKey;
+    uint32_t *albumKey;
+    uint32_t *nameKey;
+    float *duration; // seconds, 0 when unknown
+    uint32_t *coverHash; // crc32 of the embedded picture, 0 without cover
+    int64_t *modTime;
+    int64_t *fileSize;
+    uint32_t *seen; // walk that found the file last, only used by the scanner
+} LibraryTable;
+
+// the fields of a track gathered from the table
+typedef struct {
+    uint32_t id;
+    const char *filePath;
+    const char *title;
+    const char *artist;
+    const char *album;
+    const char *genre;
+    float duration;
+    uint32_t coverHash;
+} LibraryTrack;
+
+// orders of library_sort, the tracks of an album are in the order of their file names (usually numbered)
+typedef enum {
+    LIBRARY_SORT_TITLE, // title, artist, album
+    LIBRARY_SORT_ARTIST, // artist, album, file name
+    LIBRARY_SORT_ALBUM, // album, file name, title
+    LIBRARY_SORT_DURATION, // duration, title
+} LibrarySort;
+
+typedef struct {
+    size_t filesFound; // audio files found by the walker
+    size_t filesScanned; // files whose tags were already read
+    bool scanning;
+} LibraryProgress;
+
+void library_init(void);
+// stops the scan and frees the tracks
+void library_close(void);
+
+// walks the directory recursively in the background, it can be called while another scan is running
+void library_scan(const char *rootPath);
+LibraryProgress library_get_progress(void);
+// queues a single file to be read again, its entry is replaced once the tags are read
+void library_scan_file(const char *filePath);
+// removes the track of the file or, for a directory, every track inside it
+void library_remove(const char *path);
+
+// loads the tracks of a snapshot written by library_save_snapshot, it should be called before any scan
+// the strings are used from the mapping, the files are checked against their size and mtime by the next scan
+// library_save_snapshot drops the strings that aren't used anymore
+bool library_load_snapshot(const char *filePath);
+bool library_save_snapshot(const char *filePath);
+
+// the tracks can only be accessed with the lock held, the scanner adds tracks meanwhile
+// the table and the strings can move when the lock is released
+void library_lock(void);
+void library_unlock(void);
+size_t library_count(void);
+const LibraryTable *library_get_table(void);
+const char *library_get_string(uint32_t id);
+LibraryTrack library_get(size_t index);
+// returns the index of the track or SIZE_MAX if it was removed
+size_t library_find_id(uint32_t id);
+// changes every time a track is added, updated or removed
+unsigned long library_get_version(void);
+// sorts the track ids in place (stable) and drops the removed ones, returns the new count
+// the order of the keys is computed again by the first sort after the library changed
+size_t library_sort(uint32_t *ids, size_t count, LibrarySort order, bool descending);
+
+// returns true if the extension is one of the formats the player can open
+bool is_music_file(const char *filePath);
+
+#endif // LIBRARY_H
@@ -0,0 +1,218 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "CCFuncs.h"
+#include "raylib.h"
+#include "loader.h"
+#include "tags.h"
+#include "exiftool.h"
+#include "thumbcache.h"
+#include "coverstore.h"
+#include "decoder.h"
+#include "audio.h"
+
+static struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool running;
+    bool quit;
+
+    struct {
+        TrackInfo *items; // tracks waiting to be loaded
+        size_t count;
+        size_t capacity;
+    } requests;
+
+    struct {
+        MusicTrack **items; // loaded tracks waiting for the main thread
+        size_t count;
+        size_t capacity;
+    } done;
+} loader = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+// replaces the empty fields of the info, the library already has them for most tracks
+static void fill_track_info(char **field, char **tag) {
+    if((*field)[0] != '\0' || *tag == NULL || (*tag)[0] == '\0') return;
+
+    free(*field);
+    *field = *tag;
+    *tag = NULL;
+}
+
+static TrackMemory get_music_memory(const MusicTrack *track) {
+    size_t ram = sizeof(MusicTrack) + get_decoder_memory(track);
+    if(track->seekIndex != NULL) ram += track->seekIndex->points.count * sizeof(Mp3SeekPoint);
+
+    return (TrackMemory){.ram = ram, .vram = cover_store_get_size(track->cover)};
+}
+
+MusicTrack *load_music(const TrackInfo *info) {
+    const char *filePath = info->filePath;
+
+    MusicTrack *track = calloc(1, sizeof(MusicTrack));
+    track->info = copy_track_info(info);
+    track->music = LoadMusicStream(filePath);
+
+    // nobody else uses the decoder yet, so the index can be bound without the audio lock
+    track->seekIndex = get_seek_index(track->music, filePath);
+    bind_seek_index(track->music, track->seekIndex);
+
+    // the tags are read again for the cover, the library doesn't keep pictures
+    MusicTags tags;
+    bool found = read_music_tags(filePath, &tags);
+
+    // exiftool is only used for the formats that tags.c can't read
+    if(!found && !(exiftool_read_tags(&filePath, 1, &tags, &found) && found)) {
+        log_error("Failed to read the tags from %s", filePath);
+        memset(&tags, 0, sizeof(tags));
+    }
+
+    fill_track_info(&track->info.title, &tags.title);
+    fill_track_info(&track->info.artist, &tags.artist);
+    fill_track_info(&track->info.genre, &tags.genre);
+    fill_track_info(&track->info.album, &tags.album);
+    if(track->info.duration == 0) track->info.duration = tags.duration;
+
+    // the encoder delay and padding of the mp3 files are skipped so the albums play without gaps
+    init_track_decoder(track, tags.trimStart, tags.trimEnd);
+
+    uint32_t coverHash = info->coverHash;
+    if(coverHash == 0 && tags.cover != NULL) coverHash = ComputeCRC32((unsigned char*)tags.cover, tags.coverSize);
+
+    // the tracks of an album share the cover, it's only loaded when no other loaded track has it
+    // the picture is only decoded the first time, then it comes scaled from the cache
+    if(coverHash != 0 && !cover_store_acquire(coverHash)) {
+        Image cover;
+        if(!thumb_cache_load(coverHash, MUSIC_PLAYER_COVER_SIZE, &cover)) {
+            cover = make_cover_thumb(coverHash, MUSIC_PLAYER_COVER_SIZE, &tags);
+        }
+
+        if(IsImageValid(cover)) {
+            cover_store_add(coverHash, cover);
+        } else {
+            log_error("Failed to load the cover from %s", filePath);
+            coverHash = 0;
+        }
+    }
+
+    track->cover = coverHash;
+    track->memory = get_music_memory(track);
+
+    unload_music_tags(&tags);
+    return track;
+}
+
+void upload_music_cover(MusicTrack *track) {
+    cover_store_upload(track->cover);
+}
+
+void unload_music(MusicTrack *track) {
+    audio_forget_track(track);
+
+    // raudio 5.5 uninits the drwav decoder of a wav music but doesn't free it
+    void *wavContext = track->music.ctxType == RAUDIO_CONTEXT_WAV ? track->music.ctxData : NULL;
+    UnloadMusicStream(track->music);
+    free(wavContext);
+
+    if(track->seekIndex != NULL) release_seek_index(track->seekIndex);
+    free_track_info(&track->info);
+
+    cover_store_release(track->cover);
+    free(track);
+}
+
+static void *loader_worker(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&loader.lock);
+
+    while(true) {
+        while(loader.requests.count == 0 && !loader.quit) {
+            pthread_cond_wait(&loader.cond, &loader.lock);
+        }
+
+        if(loader.quit) break;
+
+        TrackInfo info = loader.requests.items[0];
+        loader.requests.count--;
+        memmove(loader.requests.items, loader.requests.items + 1, loader.requests.count * sizeof(TrackInfo));
+
+        // the lock isn't held while loading so the main thread never waits for the disk
+        pthread_mutex_unlock(&loader.lock);
+        MusicTrack *track = load_music(&info);
+        free_track_info(&info);
+        pthread_mutex_lock(&loader.lock);
+
+        da_append(&loader.done, track);
+    }
+
+    pthread_mutex_unlock(&loader.lock);
+    return NULL;
+}
+
+void loader_init(void) {
+    loader.quit = false;
+
+    if(pthread_create(&loader.thread, NULL, loader_worker, NULL) != 0) {
+        log_error("Failed to start the loader thread (%s)", "pthread_create");
+        return;
+    }
+
+    loader.running = true;
+}
+
+void loader_close(void) {
+    if(!loader.running) return;
+
+    pthread_mutex_lock(&loader.lock);
+    loader.quit = true;
+    pthread_cond_signal(&loader.cond);
+    pthread_mutex_unlock(&loader.lock);
+
+    pthread_join(loader.thread, NULL);
+    loader.running = false;
+
+    for(size_t i = 0; i < loader.requests.count; i++) free_track_info(&loader.requests.items[i]);
+    for(size_t i = 0; i < loader.done.count; i++) unload_music(loader.done.items[i]);
+    da_free(&loader.requests);
+    da_free(&loader.done);
+    memset(&loader.requests, 0, sizeof(loader.requests));
+    memset(&loader.done, 0, sizeof(loader.done));
+}
+
+void loader_request(const TrackInfo *info) {
+    TrackInfo copy = copy_track_info(info);
+
+    pthread_mutex_lock(&loader.lock);
+    da_append(&loader.requests, copy);
+    pthread_cond_signal(&loader.cond);
+    pthread_mutex_unlock(&loader.lock);
+}
+
+void loader_cancel(void) {
+    pthread_mutex_lock(&loader.lock);
+    for(size_t i = 0; i < loader.requests.count; i++) free_track_info(&loader.requests.items[i]);
+    loader.requests.count = 0;
+    pthread_mutex_unlock(&loader.lock);
+}
+
+MusicTrack *loader_poll(void) {
+    MusicTrack *track = NULL;
+
+    // the main thread calls this every frame, it never waits for the worker
+    if(pthread_mutex_trylock(&loader.lock) != 0) return NULL;
+
+    if(loader.done.count > 0) {
+        track = loader.done.items[0];
+        loader.done.count--;
+        memmove(loader.done.items, loader.done.items + 1, loader.done.count * sizeof(MusicTrack*));
+    }
+
+    pthread_mutex_unlock(&loader.lock);
+    return track;
+}
@@ -0,0 +1,29 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include "player.h"
+
+// Loads tracks in a background thread: the file is opened, the tags are read and the cover is decoded
+// and scaled there, or read from the thumbnail cache (see thumbcache.h). The only thing left for the
+// main thread is the upload of the cover (see upload_music_cover).
+
+void loader_init(void);
+// stops the thread and frees the tracks nobody took
+void loader_close(void);
+
+// queues the track (the info is copied), it's available in loader_poll once loaded
+void loader_request(const TrackInfo *info);
+// drops the requests that weren't started, the track being loaded still comes out of loader_poll
+void loader_cancel(void);
+
+// returns the next loaded track or NULL if there isn't any, the caller owns it
+MusicTrack *loader_poll(void);
+
+// opens the decoder of the track in the calling thread, the cover is decoded but not uploaded
+// the fields missing from the info are taken from the tags
+MusicTrack *load_music(const TrackInfo *info);
+// uploads the cover to the GPU unless another track already did, it has to be called from the main thread
+void upload_music_cover(MusicTrack *track);
+void unload_music(MusicTrack *track);
+
+#endif // LOADER_H
@@ -3,126 +3,121 @@
 #include <string.h>
 #include <stdlib.h>
 
-#define CCFUNCS_IMPLEMENTATION
-#include "CCFuncs.h"
 #include "raylib.h"
 #include "player.h"
+#include "loader.h"
+#include "audio.h"
+#include "exiftool.h"
+#include "seek.h"
+#include "library.h"
+#include "watcher.h"
+#include "snapshot.h"
+#include "search.h"
+#include "covers.h"
+#include "thumbcache.h"
+#include "coverstore.h"
+#include "browser.h"
+
+// after the headers that include it for the types
+#define CCFUNCS_IMPLEMENTATION
+#include "CCFuncs.h"
 
-char *read_str_from_stream(FILE *stream) {
-    StringBuilder sb = {0};
-    char c;
-    while((c = fgetc(stream)) != EOF) {
-        da_append(&sb, c);
-    }
-    char *str = sb_dump_str(&sb);
-    da_free(&sb);
-    return str;
-}
-
-// returns tag content as a string
-char *get_music_str_tag(const char *filePath, char *tagOpt) {
-    const char *cmd = TextFormat("exiftool -b %s %s", tagOpt, filePath);
-    FILE *fp = popen(cmd, "r");
-    if(fp == NULL) return NULL;
-
-    char *content = read_str_from_stream(fp);
-
-    pclose(fp);
-    return content;
-}
-
-char *get_music_title(const char *filePath) {
-    return get_music_str_tag(filePath, "-title");
-}
-
-char *get_music_artist(const char *filePath) {
-    return get_music_str_tag(filePath, "-artist");
-}
-
-char *get_music_genre(const char *filePath) {
-    return get_music_str_tag(filePath, "-genre");
-}
-
-char *get_music_album(const char *filePath) {
-    return get_music_str_tag(filePath, "-album");
-}
-
-bool load_music_cover(const char *filePath, Texture2D *dst) {
-    const char *cmd = TextFormat("exiftool -b -picture %s", filePath);
-    FILE *fp = popen(cmd, "r");
-    if(fp == NULL) return false;
-
-    struct {
-        unsigned char *items;
-        size_t count;
-        size_t capacity;
-    } buffer = {0};
-
-    int c;
-    while((c = fgetc(fp)) != EOF) {
-        da_append(&buffer, (unsigned char)c);
-    }
-
-    pclose(fp);
-
-    Image image = LoadImageFromMemory(".jpg", buffer.items, buffer.count);
-    *dst = LoadTextureFromImage(image);
-    SetTextureFilter(*dst, TEXTURE_FILTER_BILINEAR);
-    da_free(&buffer);
-    UnloadImage(image);
-
-    return true;
-}
-
-MusicTrack *load_music(const char *filePath) {
-    MusicTrack *track = calloc(1, sizeof(MusicTrack));
-    track->music = LoadMusicStream(filePath);
-    track->title = get_music_title(filePath);
-    track->artist = get_music_artist(filePath);
-    track->genre = get_music_genre(filePath);
-    track->album = get_music_album(filePath);
+#define LIBRARY_PROGRESS_SIZE 20
+#define COVERS_VRAM_BUDGET (64 * 1024 * 1024) // atlases of the grid thumbnails
+#define COVER_STORE_VRAM_BUDGET (8 * 1024 * 1024) // player covers, about 9 of them
+#define PREFETCH_TIME 30.0f // seconds before the end of the current track
+#define PREFETCH_RAM_BUDGET (4 * 1024 * 1024)
+#define PREFETCH_VRAM_BUDGET (2 * 1024 * 1024) // two covers
 
-    if(!load_music_cover(filePath, &track->cover)) {
-        log_error("Failed to load the cover from %s", filePath);
-    }
+// shows the scan counters in the bottom left corner while the library is being scanned
+static void draw_library_progress(void) {
+    LibraryProgress progress = library_get_progress();
+    if(!progress.scanning) return;
 
-    return track;
+    const char *text = TextFormat("Scanning library: %zu/%zu", progress.filesScanned, progress.filesFound);
+    DrawText(text, 10, GetScreenHeight() - LIBRARY_PROGRESS_SIZE - 10, LIBRARY_PROGRESS_SIZE, GRAY);
 }
 
-void unload_music(MusicTrack *track) {
-    UnloadMusicStream(track->music);
-    free(track->title);
-    free(track->artist);
-    free(track->genre);
-    free(track->album);
-
-    UnloadTexture(track->cover);
-    free(track);
+// the counters are printed on exit to size the budgets for the hardware
+static void log_cover_stats(const char *name, CoverCacheStats stats) {
+    TraceLog(LOG_INFO, "%s: %lu hits, %lu misses, %lu evictions, %zu/%zu KB of vram", name,
+        stats.hits, stats.misses, stats.evictions, stats.vramUsed / 1024, stats.vramBudget / 1024);
 }
 
-int main(void) {
-    const char *musicPath = "./test.mp3";
-
+// the directories passed as arguments are scanned into the library and the first file is played
+int main(int argc, char **argv) {
     InitWindow(1280, 720, "C Music");
     SetTargetFPS(60);
 
     InitAudioDevice();
+    audio_init();
+    seek_index_init();
+
+    Player player = {
+        .prefetch = {.time = PREFETCH_TIME, .ramBudget = PREFETCH_RAM_BUDGET, .vramBudget = PREFETCH_VRAM_BUDGET},
+    };
+    Browser browser = {0};
+
+    thumb_cache_init();
+    cover_store_init(COVER_STORE_VRAM_BUDGET);
+    loader_init();
+    covers_init(COVERS_VRAM_BUDGET);
+
+    // the library of the last run is shown right away, the scan only reads the files that changed
+    char *snapshotPath = get_snapshot_path();
+    if(snapshotPath != NULL) library_load_snapshot(snapshotPath);
+
+    search_init();
+    library_init();
+    watcher_init();
+
+    for(int i = 1; i < argc; i++) {
+        if(DirectoryExists(argv[i])) {
+            library_scan(argv[i]);
+            watcher_add_root(argv[i]);
+        } else {
+            player_enqueue_file(&player, argv[i]);
+        }
+    }
 
-    Player player = {0};
+    if(argc == 1) player_enqueue_file(&player, "./test.mp3");
 
-    player.track = load_music(musicPath);
+    // without files to play, the queue is the library
+    if(player.queue.count == 0) player_queue_library(&player);
+    else player_play_index(&player, 0);
 
     while(!WindowShouldClose()) {
         BeginDrawing();
         ClearBackground(BLACK);
 
         update_player(&player);
+        // the browser takes the keys while it's open
+        if(!browser.open) update_player_keys(&player);
+        update_covers();
+        update_browser(&browser, &player);
+        if(!browser.open) draw_player(&player);
+        draw_library_progress();
 
         EndDrawing();
     }
 
-    unload_music(player.track);
-    player.track = NULL;
+    watcher_close();
+    if(snapshotPath != NULL) library_save_snapshot(snapshotPath);
+    library_close();
+    search_close();
+    free(snapshotPath);
+    loader_close();
+    unload_player(&player);
+    unload_browser(&browser);
+    log_cover_stats("Thumbnails", covers_get_stats());
+    log_cover_stats("Covers", cover_store_get_stats());
+    covers_close();
+    cover_store_close();
+    thumb_cache_close();
+    audio_close();
+
+    seek_index_close();
+    exiftool_stop();
 
     CloseAudioDevice();
     CloseWindow();
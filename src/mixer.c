@@ -0,0 +1,41 @@
+#include <math.h>
+#include <string.h>
+
+#include "mixer.h"
+
+// two stereo frames, gcc turns the arithmetic into sse or neon instructions even without optimizations
+typedef float MixVector __attribute__((vector_size(16)));
+
+void mix_crossfade(float *out, const float *in, unsigned int frames, uint64_t position, uint64_t length) {
+    // the gains of two consecutive frames are rotated together by the angle of two frames, the start is
+    // computed for every call so the error doesn't build up during the fade
+    double step = M_PI / 2 / length;
+    double angle = position * step;
+
+    MixVector fadeOut = {cos(angle), cos(angle), cos(angle + step), cos(angle + step)};
+    MixVector fadeIn = {sin(angle), sin(angle), sin(angle + step), sin(angle + step)};
+    MixVector rotateCos = {0};
+    MixVector rotateSin = {0};
+    rotateCos += (float)cos(step * 2);
+    rotateSin += (float)sin(step * 2);
+
+    unsigned int i = 0;
+    for(; i + 2 <= frames; i += 2) {
+        MixVector a, b;
+        memcpy(&a, out + i * 2, sizeof(a));
+        memcpy(&b, in + i * 2, sizeof(b));
+
+        a = a * fadeOut + b * fadeIn;
+        memcpy(out + i * 2, &a, sizeof(a));
+
+        MixVector nextOut = fadeOut * rotateCos - fadeIn * rotateSin;
+        fadeIn = fadeIn * rotateCos + fadeOut * rotateSin;
+        fadeOut = nextOut;
+    }
+
+    // the odd frame uses the gains of the first half of the vectors
+    if(i < frames) {
+        out[i * 2] = out[i * 2] * fadeOut[0] + in[i * 2] * fadeIn[0];
+        out[i * 2 + 1] = out[i * 2 + 1] * fadeOut[1] + in[i * 2 + 1] * fadeIn[1];
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef MIXER_H
+#define MIXER_H
+
+#include <stdint.h>
+
+// Mixes the stereo float frames of two tracks for the crossfade, see audio.h. The curves are equal power
+// (cos and sin of a quarter turn) so the loudness doesn't dip in the middle of the fade.
+
+#define MIXER_MAX_CROSSFADE 12.0f // seconds
+
+// `out` fades out into the frames of `in`, `position` is the first frame of the fade of `length` frames
+void mix_crossfade(float *out, const float *in, unsigned int frames, uint64_t position, uint64_t length);
+
+#endif // MIXER_H
@@ -0,0 +1,99 @@
+#include <string.h>
+
+#include "mp3.h"
+
+static const int mp3Bitrates[2][3][15] = {
+    { // MPEG-1
+        {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},
+    },
+    { // MPEG-2 and MPEG-2.5
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+    },
+};
+
+static const int mp3SampleRates[3] = {44100, 48000, 32000};
+
+bool parse_mp3_header(const unsigned char *p, Mp3FrameHeader *header) {
+    if(p[0] != 0xFF || (p[1] & 0xE0) != 0xE0) return false;
+
+    int version = p[1] >> 3 & 3; // 0 = 2.5, 1 = reserved, 2 = 2, 3 = 1
+    int layer = 4 - (p[1] >> 1 & 3);
+    int bitrateIndex = p[2] >> 4;
+    int sampleRateIndex = p[2] >> 2 & 3;
+    int padding = p[2] >> 1 & 1;
+    bool protection = !(p[1] & 1);
+    bool mono = (p[3] >> 6) == 3;
+
+    if(version == 1 || layer == 4 || bitrateIndex == 0 || bitrateIndex == 15 || sampleRateIndex == 3) return false;
+
+    header->lsf = version != 3;
+    header->layer = layer;
+    header->sampleRate = mp3SampleRates[sampleRateIndex] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+    header->bitrate = mp3Bitrates[header->lsf][layer - 1][bitrateIndex] * 1000;
+
+    if(layer == 1) {
+        header->samples = 384;
+        header->length = (12 * header->bitrate / header->sampleRate + padding) * 4;
+    } else if(layer == 3 && header->lsf) {
+        header->samples = 576;
+        header->length = 72 * header->bitrate / header->sampleRate + padding;
+    } else {
+        header->samples = 1152;
+        header->length = 144 * header->bitrate / header->sampleRate + padding;
+    }
+
+    header->sideInfoStart = MP3_HEADER_SIZE + (protection ? 2 : 0);
+    header->sideInfoSize = 0;
+    if(layer == 3) {
+        if(header->lsf) header->sideInfoSize = mono ? 9 : 17;
+        else header->sideInfoSize = mono ? 17 : 32;
+    }
+
+    return header->length > header->sideInfoStart + header->sideInfoSize;
+}
+
+bool same_mp3_stream(const Mp3FrameHeader *a, const Mp3FrameHeader *b) {
+    return a->lsf == b->lsf && a->layer == b->layer && a->sampleRate == b->sampleRate;
+}
+
+bool get_mp3_encoder_delay(const unsigned char *frame, size_t size, const Mp3FrameHeader *header, unsigned int *delay, unsigned int *padding) {
+    size_t xing = header->sideInfoStart + header->sideInfoSize;
+    if(size < xing + 8 || (memcmp(frame + xing, "Xing", 4) != 0 && memcmp(frame + xing, "Info", 4) != 0)) return false;
+
+    // the optional fields: frames, bytes, TOC and quality
+    unsigned char flags = frame[xing + 7];
+    size_t lame = xing + 8 + (flags & 1 ? 4 : 0) + (flags & 2 ? 4 : 0) + (flags & 4 ? 100 : 0) + (flags & 8 ? 4 : 0);
+
+    // the encoder version is "LAME3.100" or "Lavc59.37" with ffmpeg
+    if(size < lame + 24 || (memcmp(frame + lame, "LAME", 4) != 0 && memcmp(frame + lame, "Lav", 3) != 0)) return false;
+
+    const unsigned char *p = frame + lame + 21;
+    *delay = p[0] << 4 | p[1] >> 4;
+    *padding = (p[1] & 0x0F) << 8 | p[2];
+    return true;
+}
+
+bool get_mp3_vbr_frames(const unsigned char *frame, size_t size, const Mp3FrameHeader *header, unsigned int *frames) {
+    size_t xing = header->sideInfoStart + header->sideInfoSize;
+
+    if(size >= xing + 12 && (memcmp(frame + xing, "Xing", 4) == 0 || memcmp(frame + xing, "Info", 4) == 0)) {
+        const unsigned char *p = frame + xing;
+        // frames field present
+        if(!(p[7] & 1)) return false;
+        *frames = (unsigned int)p[8] << 24 | p[9] << 16 | p[10] << 8 | p[11];
+        return true;
+    }
+
+    size_t vbri = MP3_HEADER_SIZE + 32;
+    if(size >= vbri + 18 && memcmp(frame + vbri, "VBRI", 4) == 0) {
+        const unsigned char *p = frame + vbri;
+        *frames = (unsigned int)p[14] << 24 | p[15] << 16 | p[16] << 8 | p[17];
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,34 @@
+#ifndef MP3_H
+#define MP3_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MP3_HEADER_SIZE 4
+#define MP3_DECODER_DELAY 529 // pcm frames of the synthesis filter of a layer 3 decoder
+
+typedef struct {
+    bool lsf; // low sampling frequency, MPEG-2 and MPEG-2.5
+    int layer;
+    int bitrate; // bits per second
+    int sampleRate;
+    int samples;       // pcm frames in the frame
+    int length;        // bytes of the whole frame
+    int sideInfoStart; // offset of the side information (after the crc)
+    int sideInfoSize;
+} Mp3FrameHeader;
+
+// parses the 4 bytes header of a mpeg audio frame, free format isn't supported
+bool parse_mp3_header(const unsigned char *p, Mp3FrameHeader *header);
+
+// two headers belong to the same stream when version, layer and sample rate match
+bool same_mp3_stream(const Mp3FrameHeader *a, const Mp3FrameHeader *b);
+
+// reads the frames count of the Xing/Info or VBRI header stored in the first frame
+// `size` is the number of bytes available from the start of the frame
+bool get_mp3_vbr_frames(const unsigned char *frame, size_t size, const Mp3FrameHeader *header, unsigned int *frames);
+
+// reads the encoder delay and padding (in pcm frames) of the LAME extension that follows the Xing/Info header
+bool get_mp3_encoder_delay(const unsigned char *frame, size_t size, const Mp3FrameHeader *header, unsigned int *delay, unsigned int *padding);
+
+#endif // MP3_H
@@ -1,9 +1,17 @@
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 
 #include "player.h"
+#include "loader.h"
+#include "audio.h"
+#include "coverstore.h"
+#include "library.h"
+#include "mixer.h"
+#include "CCFuncs.h"
 
 #define MUSIC_PLAYER_WIDTH 600
-#define MUSIC_PLAYER_COVER_SIZE 400 // width and height of the cover
 #define MUSIC_PLAYER_SLIDER_THICKNESS 5
 #define MUSIC_PLAYER_SLIDER_COLOR GRAY
 #define MUSIC_PLAYER_SLIDER_PLAYED_COLOR BLUE
@@ -11,9 +19,20 @@
 #define MUSIC_PLAYER_TITLE_SIZE 40
 #define MUSIC_PLAYER_TITLE_COLOR RED
 
+#define PLAYER_LIBRARY_INTERVAL 0.5 // seconds between the checks for new library tracks
+
+#define MUSIC_PLAYER_CROSSFADE_STEP 1.0f // seconds added or removed by the [ and ] keys
+
 // returns cover height
 static float draw_cover(Texture2D cover) {
     int screenWidth = GetScreenWidth();
+
+    if(cover.id == 0) {
+        Rectangle rec = {screenWidth / 2 - MUSIC_PLAYER_COVER_SIZE / 2, 0, MUSIC_PLAYER_COVER_SIZE, MUSIC_PLAYER_COVER_SIZE};
+        DrawRectangleRec(rec, DARKGRAY);
+        return MUSIC_PLAYER_COVER_SIZE;
+    }
+
     float scale = MUSIC_PLAYER_COVER_SIZE / (float)cover.width;
     float coverWidth = scale * (float)cover.width;
     Vector2 coverPos = {screenWidth / 2 - coverWidth / 2, 0};
@@ -23,25 +42,45 @@ static float draw_cover(Texture2D cover) {
 
 static void toggle_music(Player *player) {
     if(player->track == NULL) return;
-    Music music = player->track->music;
 
-    if(IsMusicStreamPlaying(music)) {
-        PauseMusicStream(music);
-    } else {
-        PlayMusicStream(music);
-    }
+    player->playing = !player->playing;
+    if(player->playing) audio_play();
+    else audio_pause();
+}
+
+// the encoder delay and padding aren't part of the length
+static float get_music_length(Player *player) {
+    if(player->track == NULL) return 0;
+    return (float)player->track->frameCount / player->track->music.stream.sampleRate;
 }
 
+// the seek is applied by the audio thread, see audio_request_seek
 static void set_music_time(Player *player, float time) {
-    if(player->track != NULL) SeekMusicStream(player->track->music, time);
+    if(player->track == NULL) return;
+
+    float length = get_music_length(player);
+    if(time < 0) time = 0;
+    else if(time > length) time = length;
+
+    audio_request_seek(time);
 }
 
+// while a seek is pending its target is shown instead of the real position
 static float get_music_time(Player *player) {
-    return player->track == NULL ? 0 : GetMusicTimePlayed(player->track->music);
+    if(player->track == NULL) return 0;
+
+    float time;
+    if(audio_get_pending_seek(&time)) return time;
+
+    return audio_get_time();
 }
 
-static float get_music_length(Player *player) {
-    return player->track == NULL ? 0 : GetMusicTimeLength(player->track->music);
+static void set_crossfade(Player *player, float seconds) {
+    if(seconds < 0) seconds = 0;
+    else if(seconds > MIXER_MAX_CROSSFADE) seconds = MIXER_MAX_CROSSFADE;
+
+    player->crossfade = seconds;
+    audio_set_crossfade(seconds);
 }
 
 static void draw_player_button(Player *player) {
@@ -101,6 +140,8 @@ static void draw_player_slider(Player *player, Vector2 pos, float width) {
 
     if(IsMouseButtonReleased(MOUSE_LEFT_BUTTON) && player->sliding) {
         player->sliding = false;
+        // the position where the mouse was released doesn't wait for the seek interval
+        audio_flush_seek();
     }
 }
 
@@ -136,7 +177,35 @@ static void draw_title(Player *player, char *title, Vector2 pos, float maxWidth)
     EndScissorMode();
 }
 
-static void draw_player(Player *player) {
+void update_player_keys(Player *player) {
+    if(player->track == NULL) return;
+
+    if(IsKeyPressed(KEY_SPACE)) {
+        toggle_music(player);
+    }
+
+    if(IsKeyPressed(KEY_N) && player->queueIndex + 1 < player->queue.count) {
+        player_play_index(player, player->queueIndex + 1);
+    } else if(IsKeyPressed(KEY_P) && player->queueIndex > 0) {
+        player_play_index(player, player->queueIndex - 1);
+    }
+
+    if(IsKeyPressed(KEY_RIGHT_BRACKET)) {
+        set_crossfade(player, player->crossfade + MUSIC_PLAYER_CROSSFADE_STEP);
+    } else if(IsKeyPressed(KEY_LEFT_BRACKET)) {
+        set_crossfade(player, player->crossfade - MUSIC_PLAYER_CROSSFADE_STEP);
+    }
+
+    float time = get_music_time(player);
+
+    if(IsKeyPressed(KEY_RIGHT)) {
+        set_music_time(player, time + 5);
+    } else if(IsKeyPressed(KEY_LEFT)) {
+        set_music_time(player, time - 5);
+    }
+}
+
+void draw_player(Player *player) {
     // TODO: make a placeholder
     if(player->track == NULL) return;
 
@@ -145,7 +214,7 @@ static void draw_player(Player *player) {
 
     float center = screenWidth / 2 - MUSIC_PLAYER_WIDTH / 2;
 
-    posY += draw_cover(player->track->cover);
+    posY += draw_cover(cover_store_get(player->track->cover));
 
     int padding = 20;
     posY += padding;
@@ -153,35 +222,398 @@ static void draw_player(Player *player) {
     // title
     Vector2 titlePos = {center + padding, posY};
     float titleMaxWidth = MUSIC_PLAYER_WIDTH - padding * 2;
-    draw_title(player, player->track->title, titlePos, titleMaxWidth);
+    draw_title(player, player->track->info.title, titlePos, titleMaxWidth);
     posY += MUSIC_PLAYER_TITLE_SIZE;
 
-    char *artist = player->track->artist;
+    char *artist = player->track->info.artist;
     DrawText(artist, center + padding, posY, 30, GRAY);
 
     draw_player_button(player);
+    if(player->crossfade > 0) DrawText(TextFormat("Crossfade: %.0fs", player->crossfade), 110, 5, 20, GRAY);
 
     Vector2 sliderPos = {100, 600};
     float sliderWidth = 1080;
     draw_player_slider(player, sliderPos, sliderWidth);
 }
 
-void update_player(Player *player) {
-    if(player->track == NULL) return;
+// binds the index to the track unless it already has one, takes the ownership of the index
+static void set_track_seek_index(MusicTrack *track, SeekIndex *index) {
+    if(track->seekIndex != NULL || strcmp(track->info.filePath, index->filePath) != 0) {
+        release_seek_index(index);
+        return;
+    }
 
-    UpdateMusicStream(player->track->music);
+    audio_lock();
+    bind_seek_index(track->music, index);
+    audio_unlock();
 
-    if(IsKeyPressed(KEY_SPACE)) {
-        toggle_music(player);
+    track->seekIndex = index;
+    track->memory.ram += index->points.count * sizeof(Mp3SeekPoint);
+}
+
+// the loaded track of the file, NULL if it's neither the current one nor prefetched
+static MusicTrack *find_loaded_track(Player *player, const char *filePath) {
+    if(player->track != NULL && strcmp(player->track->info.filePath, filePath) == 0) return player->track;
+
+    for(size_t i = 0; i < PLAYER_PREFETCH_COUNT; i++) {
+        MusicTrack *track = player->ahead[i].track;
+        if(track != NULL && strcmp(track->info.filePath, filePath) == 0) return track;
     }
 
-    float time = get_music_time(player);
+    return NULL;
+}
 
-    if(IsKeyPressed(KEY_RIGHT)) {
-        set_music_time(player, time + 5);
-    } else if(IsKeyPressed(KEY_LEFT)) {
-        set_music_time(player, time - 5);
+// binds the indexes finished by the background scan
+static void update_seek_index(Player *player) {
+    SeekIndex *index;
+    while((index = seek_index_poll()) != NULL) {
+        MusicTrack *track = find_loaded_track(player, index->filePath);
+
+        if(track == NULL) {
+            release_seek_index(index);
+        } else {
+            set_track_seek_index(track, index);
+        }
+    }
+}
+
+// the scan could have finished while the track was waiting in the loader
+static void check_cached_seek_index(MusicTrack *track) {
+    if(track->seekIndex == NULL) {
+        SeekIndex *cached = get_cached_seek_index(track->info.filePath);
+        if(cached != NULL) set_track_seek_index(track, cached);
     }
+}
+
+// replaces the current track, this is the only loading work done in the main thread
+static void set_player_track(Player *player, MusicTrack *track) {
+    upload_music_cover(track);
+
+    MusicTrack *previous = player->track;
+
+    audio_set_track(track);
+    audio_set_next(player->ahead[0].track);
+    if(player->playing) audio_play();
+    if(previous != NULL) unload_music(previous);
+
+    player->track = track;
+    player->titleOffset = 0;
+    player->sliding = false;
 
-    draw_player(player);
+    check_cached_seek_index(track);
+}
+
+static bool is_queue_entry(Player *player, size_t index, MusicTrack *track) {
+    if(index >= player->queue.count) return false;
+
+    QueueEntry *entry = &player->queue.items[index];
+    if(entry->filePath == NULL) return track->info.id == entry->id;
+    return track->info.id == PLAYER_NO_ID && strcmp(entry->filePath, track->info.filePath) == 0;
+}
+
+// the prefetch slots after the entry move back with the entries, its own slot is empty
+static void remove_queue_entry(Player *player, size_t index) {
+    free(player->queue.items[index].filePath);
+    player->queue.count--;
+    memmove(player->queue.items + index, player->queue.items + index + 1, (player->queue.count - index) * sizeof(QueueEntry));
+
+    if(index <= player->queueIndex) return;
+
+    size_t slot = index - player->queueIndex - 1;
+    if(slot >= PLAYER_PREFETCH_COUNT) return;
+
+    memmove(player->ahead + slot, player->ahead + slot + 1, (PLAYER_PREFETCH_COUNT - slot - 1) * sizeof(PrefetchSlot));
+    player->ahead[PLAYER_PREFETCH_COUNT - 1] = (PrefetchSlot){0};
+}
+
+// gives the entry to the loader, a library track that was removed is dropped from the queue instead
+static bool request_queue_entry(Player *player, size_t index) {
+    QueueEntry *entry = &player->queue.items[index];
+
+    if(entry->filePath != NULL) {
+        loader_request(&(TrackInfo){.id = PLAYER_NO_ID, .filePath = entry->filePath});
+        return true;
+    }
+
+    library_lock();
+
+    size_t libraryIndex = library_find_id(entry->id);
+    if(libraryIndex != SIZE_MAX) {
+        LibraryTrack track = library_get(libraryIndex);
+        // the loader copies the strings before the lock is released
+        loader_request(&(TrackInfo){
+            .id = track.id,
+            .filePath = (char*)track.filePath,
+            .title = (char*)track.title,
+            .artist = (char*)track.artist,
+            .genre = (char*)track.genre,
+            .album = (char*)track.album,
+            .duration = track.duration,
+            .coverHash = track.coverHash,
+        });
+    }
+
+    library_unlock();
+
+    if(libraryIndex == SIZE_MAX) remove_queue_entry(player, index);
+    return libraryIndex != SIZE_MAX;
+}
+
+// the loaded track becomes the current one or goes to its prefetch slot, the ones for entries that aren't
+// needed anymore (the user jumped somewhere else meanwhile) are unloaded
+static void receive_track(Player *player, MusicTrack *track) {
+    if(is_queue_entry(player, player->queueIndex, track)) {
+        if(player->trackRequested) {
+            player->trackRequested = false;
+            set_player_track(player, track);
+        } else {
+            unload_music(track);
+        }
+        return;
+    }
+
+    PrefetchSlot *slot = NULL;
+    for(size_t i = 0; i < PLAYER_PREFETCH_COUNT && slot == NULL; i++) {
+        if(player->ahead[i].requested && is_queue_entry(player, player->queueIndex + 1 + i, track)) slot = &player->ahead[i];
+    }
+
+    if(slot == NULL) {
+        unload_music(track);
+        return;
+    }
+
+    slot->requested = false;
+    if(slot->track != NULL) unload_music(slot->track);
+    upload_music_cover(track);
+    check_cached_seek_index(track);
+    slot->track = track;
+
+    if(slot == &player->ahead[0]) audio_set_next(track);
+}
+
+// moves the prefetched tracks to the slots of their entries after a jump in the queue, the others are
+// unloaded
+static void arrange_prefetched(Player *player) {
+    MusicTrack *next = player->ahead[0].track;
+
+    MusicTrack *loaded[PLAYER_PREFETCH_COUNT];
+    for(size_t i = 0; i < PLAYER_PREFETCH_COUNT; i++) {
+        loaded[i] = player->ahead[i].track;
+        player->ahead[i].track = NULL;
+    }
+
+    for(size_t i = 0; i < PLAYER_PREFETCH_COUNT; i++) {
+        for(size_t j = 0; j < PLAYER_PREFETCH_COUNT; j++) {
+            if(loaded[j] == NULL || !is_queue_entry(player, player->queueIndex + 1 + i, loaded[j])) continue;
+
+            player->ahead[i].track = loaded[j];
+            loaded[j] = NULL;
+            break;
+        }
+    }
+
+    for(size_t i = 0; i < PLAYER_PREFETCH_COUNT; i++) {
+        if(loaded[i] != NULL) unload_music(loaded[i]);
+    }
+
+    if(player->ahead[0].track != next) audio_set_next(player->ahead[0].track);
+}
+
+// the current track is used as the cost of the ones that aren't loaded yet
+static void request_prefetch(Player *player) {
+    float left = get_music_length(player) - get_music_time(player);
+    TrackMemory expected = player->track->memory;
+    TrackMemory used = {0};
+
+    for(size_t i = 0; i < PLAYER_PREFETCH_COUNT; i++) {
+        size_t index = player->queueIndex + 1 + i;
+        if(index >= player->queue.count) return;
+
+        PrefetchSlot *slot = &player->ahead[i];
+        TrackMemory memory = slot->track == NULL ? expected : slot->track->memory;
+
+        // the next entry is always loaded, the audio thread needs it for the splice
+        if(slot->track == NULL && !slot->requested && i > 0) {
+            if(left > player->prefetch.time) return;
+            if(used.ram + memory.ram > player->prefetch.ramBudget || used.vram + memory.vram > player->prefetch.vramBudget) return;
+        }
+
+        used.ram += memory.ram;
+        used.vram += memory.vram;
+
+        if(slot->track == NULL && !slot->requested) {
+            // the entries after it moved back, they're requested in the next frame
+            if(!request_queue_entry(player, index)) return;
+            slot->requested = true;
+        }
+    }
+}
+
+// keeps the decoders of the current entry and the prefetched ones after it, nothing else of the queue is
+// loaded
+static void request_tracks(Player *player) {
+    if(player->queueIndex >= player->queue.count) return;
+
+    MusicTrack *track = player->track;
+    bool current = track != NULL && is_queue_entry(player, player->queueIndex, track);
+
+    for(size_t i = 0; i < PLAYER_PREFETCH_COUNT && !current; i++) {
+        MusicTrack *prefetched = player->ahead[i].track;
+        if(prefetched == NULL || !is_queue_entry(player, player->queueIndex, prefetched)) continue;
+
+        player->ahead[i].track = NULL;
+        set_player_track(player, prefetched);
+        current = true;
+    }
+
+    arrange_prefetched(player);
+
+    if(!current) {
+        if(!player->trackRequested) player->trackRequested = request_queue_entry(player, player->queueIndex);
+        return;
+    }
+
+    request_prefetch(player);
+}
+
+// the audio thread continues with the next track without a gap, the player only follows it
+static void follow_audio(Player *player) {
+    MusicTrack *next = player->ahead[0].track;
+    if(next == NULL || audio_get_playing() != next) return;
+
+    MusicTrack *previous = player->track;
+
+    player->queueIndex++;
+    player->track = next;
+    player->titleOffset = 0;
+    player->sliding = false;
+
+    // the requests in flight keep their entries
+    memmove(player->ahead, player->ahead + 1, (PLAYER_PREFETCH_COUNT - 1) * sizeof(PrefetchSlot));
+    player->ahead[PLAYER_PREFETCH_COUNT - 1] = (PrefetchSlot){0};
+    audio_set_next(player->ahead[0].track);
+
+    if(previous != NULL) unload_music(previous);
+}
+
+// only reached when the next track couldn't be spliced, it wasn't loaded in time or has another sample rate
+static void check_track_end(Player *player) {
+    if(player->track == NULL || !player->playing || player->trackRequested) return;
+    if(!audio_is_finished()) return;
+
+    if(player->queueIndex + 1 < player->queue.count) {
+        player_play_index(player, player->queueIndex + 1);
+    } else {
+        player->playing = false;
+    }
+}
+
+TrackInfo copy_track_info(const TrackInfo *info) {
+    return (TrackInfo){
+        .id = info->id,
+        .filePath = strdup(info->filePath),
+        .title = strdup(info->title == NULL ? "" : info->title),
+        .artist = strdup(info->artist == NULL ? "" : info->artist),
+        .genre = strdup(info->genre == NULL ? "" : info->genre),
+        .album = strdup(info->album == NULL ? "" : info->album),
+        .duration = info->duration,
+        .coverHash = info->coverHash,
+    };
+}
+
+void free_track_info(TrackInfo *info) {
+    free(info->filePath);
+    free(info->title);
+    free(info->artist);
+    free(info->genre);
+    free(info->album);
+    memset(info, 0, sizeof(TrackInfo));
+}
+
+void player_enqueue_file(Player *player, const char *filePath) {
+    da_append(&player->queue, ((QueueEntry){.id = PLAYER_NO_ID, .filePath = strdup(filePath)}));
+}
+
+void player_enqueue_tracks(Player *player, const uint32_t *ids, size_t count) {
+    for(size_t i = 0; i < count; i++) da_append(&player->queue, ((QueueEntry){.id = ids[i]}));
+}
+
+// the loaded tracks are kept, request_tracks moves them to their new entries or unloads them
+static void cancel_requests(Player *player) {
+    loader_cancel();
+    player->trackRequested = false;
+    for(size_t i = 0; i < PLAYER_PREFETCH_COUNT; i++) player->ahead[i].requested = false;
+}
+
+// the ids increase with the index, so the new tracks are at the end of the table
+static void sync_library_queue(Player *player) {
+    bool empty = player->queue.count == 0;
+
+    library_lock();
+
+    unsigned long version = library_get_version();
+    if(version != player->libraryVersion) {
+        const LibraryTable *table = library_get_table();
+
+        size_t first = table->count;
+        while(first > 0 && table->id[first - 1] >= player->libraryNextId) first--;
+
+        player_enqueue_tracks(player, table->id + first, table->count - first);
+        if(first < table->count) player->libraryNextId = table->id[table->count - 1] + 1;
+        player->libraryVersion = version;
+    }
+
+    library_unlock();
+    player->librarySyncTime = GetTime();
+
+    // nothing was playing because the library was empty
+    if(empty && player->queue.count > 0) player_play_index(player, 0);
+}
+
+void player_queue_library(Player *player) {
+    player_clear_queue(player);
+    player->followLibrary = true;
+    player->libraryVersion = ULONG_MAX; // never a version, the whole library is compared
+    player->libraryNextId = 0;
+    sync_library_queue(player);
+}
+
+// the tracks keep playing until the new entries are loaded
+void player_clear_queue(Player *player) {
+    for(size_t i = 0; i < player->queue.count; i++) free(player->queue.items[i].filePath);
+    player->queue.count = 0;
+    player->queueIndex = 0;
+    player->followLibrary = false;
+    cancel_requests(player);
+}
+
+void player_play_index(Player *player, size_t index) {
+    if(index >= player->queue.count) return;
+
+    player->queueIndex = index;
+    cancel_requests(player);
+    request_tracks(player);
+}
+
+void unload_player(Player *player) {
+    audio_set_track(NULL);
+    if(player->track != NULL) unload_music(player->track);
+    for(size_t i = 0; i < PLAYER_PREFETCH_COUNT; i++) {
+        if(player->ahead[i].track != NULL) unload_music(player->ahead[i].track);
+    }
+
+    for(size_t i = 0; i < player->queue.count; i++) free(player->queue.items[i].filePath);
+    da_free(&player->queue);
+    memset(player, 0, sizeof(Player));
+}
+
+void update_player(Player *player) {
+    if(player->followLibrary && GetTime() - player->librarySyncTime >= PLAYER_LIBRARY_INTERVAL) sync_library_queue(player);
+
+    MusicTrack *loaded;
+    while((loaded = loader_poll()) != NULL) receive_track(player, loaded);
+    update_seek_index(player);
+    follow_audio(player);
+    check_track_end(player);
+    request_tracks(player);
 }
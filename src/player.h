@@ -1,23 +1,115 @@
 #ifndef PLAYER_H
 #define PLAYER_H
 
+#include <stdint.h>
+#include <stddef.h>
+
 #include "raylib.h"
+#include "seek.h"
+
+#define MUSIC_PLAYER_COVER_SIZE 400 // width and height of the cover, the loader scales the pictures to it
+#define PLAYER_PREFETCH_COUNT 2 // entries after the current one that can be loaded ahead
+#define PLAYER_NO_ID UINT32_MAX // TrackInfo.id of the files that aren't in the library
 
+// Description of a track given to the loader. Only the tracks that are playing or about to play get a
+// MusicTrack with the decoder and a reference to the cover.
 typedef struct {
-    Music music;
+    uint32_t id; // library track id (see library.h) or PLAYER_NO_ID
+    char *filePath;
+    // empty for the files that aren't in the library until they are loaded
     char *title;
     char *artist;
     char *genre;
     char *album;
-    Texture2D cover;
+    float duration;
+    uint32_t coverHash;
+} TrackInfo;
+
+// The queue only holds the library ids, the strings are read from the library when the entry is loaded.
+// A removed track is dropped from the queue when its turn comes.
+typedef struct {
+    uint32_t id;
+    char *filePath; // only for the files that aren't in the library, NULL for the library tracks
+} QueueEntry;
+
+// what a loaded track keeps allocated, the decoder is estimated from its format (see get_decoder_memory)
+// and the cover is counted in vram even when it's shared
+typedef struct {
+    size_t ram;
+    size_t vram;
+} TrackMemory;
+
+typedef struct {
+    TrackInfo info;
+    Music music; // only its decoder is used, see decoder.h
+    // pcm frames of the music without the encoder delay and padding, the position is only changed by the
+    // audio thread once the track was given to it
+    uint64_t trimStart;
+    uint64_t frameCount;
+    uint64_t position;
+    SeekIndex *seekIndex; // bound to the music, NULL if it isn't a mp3
+    uint32_t cover; // reference in the cover store (see coverstore.h), 0 without cover
+    TrackMemory memory; // worked out once loaded, the seek points bound later are added to it
 } MusicTrack;
 
+// an entry after the current one, loaded ahead so switching to it is instant
 typedef struct {
-    MusicTrack *track; // song playing currently
+    MusicTrack *track;
+    bool requested;
+} PrefetchSlot;
+
+// The entry after the current one is always loaded, the audio thread splices it. The ones after it are
+// loaded when the current track has less than `time` seconds left and the prefetched tracks fit in the
+// budgets, counted from what the current track uses.
+typedef struct {
+    float time;
+    size_t ramBudget;
+    size_t vramBudget;
+} PlayerPrefetch;
+
+typedef struct {
+    struct {
+        QueueEntry *items;
+        size_t count;
+        size_t capacity;
+    } queue;
+    size_t queueIndex; // entry of the current track
+    // the queue is the library, the tracks found by the scan are appended to it
+    bool followLibrary;
+    unsigned long libraryVersion; // when the queue was last compared with the library
+    uint32_t libraryNextId; // ids from this one weren't queued yet
+    double librarySyncTime;
+
+    MusicTrack *track; // song playing currently, NULL until the entry is loaded
+    bool trackRequested;
+    PrefetchSlot ahead[PLAYER_PREFETCH_COUNT]; // the entries right after the current one in order
+    PlayerPrefetch prefetch;
+
+    bool playing; // the user wants the music to play, the next entry starts when the current ends
+    float crossfade; // seconds the tracks overlap, see audio_set_crossfade
     bool sliding;
     float titleOffset; // used to animate the title when it's too big
 } Player;
 
+// every string is copied, NULL ones are taken as ""
+TrackInfo copy_track_info(const TrackInfo *info);
+void free_track_info(TrackInfo *info);
+
+// the path is copied, the tags are read when the file is loaded
+void player_enqueue_file(Player *player, const char *filePath);
+void player_enqueue_tracks(Player *player, const uint32_t *ids, size_t count);
+void player_clear_queue(Player *player);
+// replaces the queue with the library and keeps appending the tracks it gets, until the queue is cleared
+void player_queue_library(Player *player);
+// the track is loaded in the background, the current one plays until then
+void player_play_index(Player *player, size_t index);
+// loads the tracks of the queue and moves to the next one at the end, it has to be called every frame
 void update_player(Player *player);
+// space, N/P, the arrows and [ ] control the playback
+void update_player_keys(Player *player);
+// the now playing view, its button and slider
+void draw_player(Player *player);
+// unloads the tracks and frees the queue
+void unload_player(Player *player);
 
 #endif // PLAYER_H
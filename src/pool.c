@@ -0,0 +1,96 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "CCFuncs.h"
+#include "pool.h"
+
+#define POOL_INTERNED_MIN_CAPACITY 1024
+
+// FNV-1a
+static uint64_t hash_string(const char *str) {
+    uint64_t hash = 14695981039346656037ULL;
+    for(const unsigned char *c = (const unsigned char*)str; *c != '\0'; c++) {
+        hash = (hash ^ *c) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+void pool_init(StringPool *pool, const char *base, size_t baseSize) {
+    memset(pool, 0, sizeof(StringPool));
+    pool->base = base;
+    pool->baseSize = base == NULL ? 0 : baseSize;
+
+    if(pool->baseSize == 0) da_append(&pool->arena, '\0');
+}
+
+void pool_free(StringPool *pool) {
+    da_free(&pool->arena);
+    free(pool->interned.items);
+    memset(pool, 0, sizeof(StringPool));
+}
+
+uint32_t pool_add(StringPool *pool, const char *str) {
+    if(str[0] == '\0') return POOL_EMPTY_STRING;
+
+    uint32_t id = pool->baseSize + pool->arena.count;
+    da_append_many(&pool->arena, str, strlen(str) + 1);
+    return id;
+}
+
+// returns the slot of the string or the empty slot where it should go
+static size_t find_interned_slot(const StringPool *pool, const char *str) {
+    size_t mask = pool->interned.capacity - 1;
+    size_t slot = hash_string(str) & mask;
+
+    while(pool->interned.items[slot] != UINT32_MAX) {
+        if(strcmp(pool_get(pool, pool->interned.items[slot]), str) == 0) break;
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+// keeps the table at most half full
+static void grow_interned(StringPool *pool) {
+    if(pool->interned.capacity != 0 && (pool->interned.count + 1) * 2 <= pool->interned.capacity) return;
+
+    uint32_t *old = pool->interned.items;
+    size_t oldCapacity = pool->interned.capacity;
+
+    size_t capacity = oldCapacity == 0 ? POOL_INTERNED_MIN_CAPACITY : oldCapacity * 2;
+    pool->interned.items = malloc(capacity * sizeof(uint32_t));
+    pool->interned.capacity = capacity;
+    memset(pool->interned.items, 0xFF, capacity * sizeof(uint32_t));
+
+    for(size_t i = 0; i < oldCapacity; i++) {
+        if(old[i] == UINT32_MAX) continue;
+        pool->interned.items[find_interned_slot(pool, pool_get(pool, old[i]))] = old[i];
+    }
+
+    free(old);
+}
+
+uint32_t pool_intern(StringPool *pool, const char *str) {
+    if(str[0] == '\0') return POOL_EMPTY_STRING;
+
+    grow_interned(pool);
+    size_t slot = find_interned_slot(pool, str);
+    if(pool->interned.items[slot] != UINT32_MAX) return pool->interned.items[slot];
+
+    uint32_t id = pool_add(pool, str);
+    pool->interned.items[slot] = id;
+    pool->interned.count++;
+    return id;
+}
+
+void pool_register(StringPool *pool, uint32_t id) {
+    const char *str = pool_get(pool, id);
+    if(str[0] == '\0') return;
+
+    grow_interned(pool);
+    size_t slot = find_interned_slot(pool, str);
+    if(pool->interned.items[slot] != UINT32_MAX) return;
+
+    pool->interned.items[slot] = id;
+    pool->interned.count++;
+}
@@ -0,0 +1,47 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Strings stored one after another in a single arena and referenced by their offset (the id). The first
+// part can be a read only block, like the strings of a mapped snapshot, the ids after it are in the arena.
+// The pointers returned by pool_get are invalidated by the next pool_add/pool_intern.
+
+#define POOL_EMPTY_STRING 0 // id of "", every pool starts with it
+
+typedef struct {
+    const char *base;
+    size_t baseSize;
+
+    struct {
+        char *items;
+        size_t count;
+        size_t capacity;
+    } arena;
+
+    // open addressing table of the interned ids, UINT32_MAX is an empty slot
+    struct {
+        uint32_t *items;
+        size_t count;
+        size_t capacity;
+    } interned;
+} StringPool;
+
+// the base has to start with "" and end with a null, it isn't copied
+void pool_init(StringPool *pool, const char *base, size_t baseSize);
+void pool_free(StringPool *pool);
+
+// copies the string, equal strings get different ids
+uint32_t pool_add(StringPool *pool, const char *str);
+// returns the id of an equal interned string or adds it, repeated artists and albums are stored once
+uint32_t pool_intern(StringPool *pool, const char *str);
+// marks a string that is already in the pool (e.g. in the base) as interned
+void pool_register(StringPool *pool, uint32_t id);
+
+static inline const char *pool_get(const StringPool *pool, uint32_t id) {
+    return id < pool->baseSize ? pool->base + id : pool->arena.items + (id - pool->baseSize);
+}
+
+#endif // POOL_H
@@ -0,0 +1,687 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "CCFuncs.h"
+#include "search.h"
+#include "text.h"
+#include "fuzzy.h"
+
+// between the folded fields of a track, fold_text never outputs it
+#define SEARCH_FIELD_SEPARATOR '\x1f'
+// words are indexed by their first 1, 2 and 3 bytes
+#define SEARCH_PREFIX_LENGTH 3
+// match_text calls of search_query in a frame, the rest of the candidates are checked in the next ones
+#define SEARCH_QUERY_CHECKS 4096
+// the fuzzy thread holds the lock for this many tracks at a time and checks for a newer query between them
+#define SEARCH_FUZZY_CHUNK 4096
+
+typedef struct {
+    uint32_t *items;
+    size_t count;
+    size_t capacity;
+} IdList;
+
+typedef struct {
+    uint32_t *items;
+    uint8_t *scores; // the score_word of the best word of the track starting with the prefix
+    size_t count;
+    size_t capacity;
+} PostingList;
+
+typedef struct {
+    uint32_t id;
+    int score;
+} SearchMatch;
+
+// a query being checked, it continues in the next frame while the index doesn't change
+typedef struct {
+    bool active;
+    StringBuilder folded;
+    unsigned long long version;
+    char *buffer; // the words point inside it
+    struct {
+        char **items;
+        size_t count;
+        size_t capacity;
+    } words;
+    bool refine; // the matches of the last query can be the candidates
+    size_t next; // the next candidate to check
+    SearchMatch *heap;
+    size_t heapCount;
+    IdList matches;
+} SearchQuery;
+
+static struct {
+    pthread_mutex_t lock;
+
+    // folded "title\x1fartist\x1falbum\x1fgenre" by track id, NULL when removed
+    struct {
+        char **items;
+        size_t count;
+        size_t capacity;
+    } texts;
+    // fuzzy_signature of the texts, for the fuzzy search
+    struct {
+        uint64_t *items;
+        size_t count;
+        size_t capacity;
+    } signatures;
+    // the ids removed or added again, their old entries are still in the posting lists
+    struct {
+        bool *items;
+        size_t count;
+        size_t capacity;
+    } replaced;
+
+    // open addressing table from a word prefix to its posting list, 0 is an empty key
+    // the lists aren't cleaned when a track is removed or changes, the entries of replaced ids are checked
+    // with their text
+    struct {
+        uint32_t *keys;
+        uint32_t *lists;
+        size_t count;
+        size_t capacity;
+    } prefixes;
+
+    struct {
+        PostingList *items;
+        size_t count;
+        size_t capacity;
+    } lists;
+
+    unsigned long long version; // changes with every add and remove
+
+    // the last query and its matches, the next keystroke only checks those
+    StringBuilder lastQuery;
+    unsigned long long lastVersion;
+    IdList candidates;
+    SearchQuery query;
+
+    // marks the ids already checked by a query, the posting lists can have an id twice
+    uint32_t *stamps;
+    size_t stampsCount;
+    uint32_t stamp;
+
+    pthread_mutex_t fuzzyLock; // protects everything below
+    pthread_cond_t fuzzyCond;
+    pthread_t fuzzyThread;
+    bool fuzzyRunning;
+    bool fuzzyQuit;
+    char *fuzzyQuery; // waiting for the thread, a newer request replaces it and cancels the running one
+    unsigned int fuzzyGeneration; // incremented by every request, older results are dropped
+    SearchResults fuzzyResults;
+    bool fuzzyReady;
+} search = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .fuzzyLock = PTHREAD_MUTEX_INITIALIZER,
+    .fuzzyCond = PTHREAD_COND_INITIALIZER,
+};
+
+static bool is_word_byte(char c) {
+    return c != ' ' && c != SEARCH_FIELD_SEPARATOR && c != '\0';
+}
+
+static bool is_word_start(const char *text, const char *p) {
+    return p == text || p[-1] == ' ' || p[-1] == SEARCH_FIELD_SEPARATOR;
+}
+
+// the length goes in the high byte so "ab" and "ab\0" are different keys and no key is 0
+static uint32_t get_prefix_key(const char *word, int length) {
+    uint32_t key = (uint32_t)length << 24;
+    for(int i = 0; i < length; i++) key |= (uint32_t)(unsigned char)word[i] << (8 * (2 - i));
+    return key;
+}
+
+// returns the slot of the key or the empty slot where it should go
+static size_t find_prefix_slot(uint32_t key) {
+    size_t mask = search.prefixes.capacity - 1;
+    size_t slot = (key * 2654435761u) & mask;
+
+    while(search.prefixes.keys[slot] != 0 && search.prefixes.keys[slot] != key) {
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+// keeps the table at most half full
+static void grow_prefixes(void) {
+    if(search.prefixes.capacity != 0 && (search.prefixes.count + 1) * 2 <= search.prefixes.capacity) return;
+
+    uint32_t *oldKeys = search.prefixes.keys;
+    uint32_t *oldLists = search.prefixes.lists;
+    size_t oldCapacity = search.prefixes.capacity;
+
+    search.prefixes.capacity = oldCapacity == 0 ? 4096 : oldCapacity * 2;
+    search.prefixes.keys = calloc(search.prefixes.capacity, sizeof(uint32_t));
+    search.prefixes.lists = malloc(search.prefixes.capacity * sizeof(uint32_t));
+
+    for(size_t i = 0; i < oldCapacity; i++) {
+        if(oldKeys[i] == 0) continue;
+        size_t slot = find_prefix_slot(oldKeys[i]);
+        search.prefixes.keys[slot] = oldKeys[i];
+        search.prefixes.lists[slot] = oldLists[i];
+    }
+
+    free(oldKeys);
+    free(oldLists);
+}
+
+static PostingList *get_prefix_list(uint32_t key) {
+    if(search.prefixes.capacity == 0) return NULL;
+
+    size_t slot = find_prefix_slot(key);
+    return search.prefixes.keys[slot] == 0 ? NULL : &search.lists.items[search.prefixes.lists[slot]];
+}
+
+static void add_prefix(uint32_t key, uint32_t id, int score) {
+    grow_prefixes();
+    size_t slot = find_prefix_slot(key);
+
+    if(search.prefixes.keys[slot] == 0) {
+        search.prefixes.keys[slot] = key;
+        search.prefixes.lists[slot] = search.lists.count;
+        search.prefixes.count++;
+        da_append(&search.lists, ((PostingList){0}));
+    }
+
+    // a track with many words starting the same way is added once with the best score
+    PostingList *list = &search.lists.items[search.prefixes.lists[slot]];
+    if(list->count > 0 && list->items[list->count - 1] == id) {
+        if(score > list->scores[list->count - 1]) list->scores[list->count - 1] = score;
+        return;
+    }
+
+    size_t capacity = list->capacity;
+    da_append(list, id);
+    if(list->capacity != capacity) list->scores = realloc(list->scores, list->capacity * sizeof(uint8_t));
+    list->scores[list->count - 1] = score;
+}
+
+// title matches count more than artist ones and so on
+static int get_field_score(const char *text, const char *p) {
+    static const int fieldScores[] = {8, 4, 2, 1};
+
+    int field = 0;
+    for(const char *c = text; c < p; c++) field += *c == SEARCH_FIELD_SEPARATOR;
+    return fieldScores[field < 4 ? field : 3] * 4;
+}
+
+// a whole word counts more than a prefix
+static int score_word(const char *text, const char *p, size_t length) {
+    int score = get_field_score(text, p);
+    if(!is_word_byte(p[length])) score += 2;
+    if(p == text || p[-1] == SEARCH_FIELD_SEPARATOR) score += 1;
+    return score;
+}
+
+void search_index_add(uint32_t id, const char *title, const char *artist, const char *album, const char *genre) {
+    StringBuilder sb = {0};
+    fold_text(&sb, title);
+    da_append(&sb, SEARCH_FIELD_SEPARATOR);
+    fold_text(&sb, artist);
+    da_append(&sb, SEARCH_FIELD_SEPARATOR);
+    fold_text(&sb, album);
+    da_append(&sb, SEARCH_FIELD_SEPARATOR);
+    fold_text(&sb, genre);
+    da_append(&sb, '\0');
+    char *text = sb.items;
+
+    pthread_mutex_lock(&search.lock);
+
+    while(search.texts.count <= id) {
+        da_append(&search.texts, NULL);
+        da_append(&search.signatures, 0);
+        da_append(&search.replaced, false);
+    }
+    if(search.texts.items[id] != NULL) search.replaced.items[id] = true;
+    free(search.texts.items[id]);
+    search.texts.items[id] = text;
+    search.signatures.items[id] = fuzzy_signature(text, sb.count - 1);
+
+    for(const char *p = text; *p != '\0'; p++) {
+        if(!is_word_byte(*p) || !is_word_start(text, p)) continue;
+
+        for(int length = 1; length <= SEARCH_PREFIX_LENGTH && is_word_byte(p[length - 1]); length++) {
+            add_prefix(get_prefix_key(p, length), id, score_word(text, p, length));
+        }
+    }
+
+    search.version++;
+    pthread_mutex_unlock(&search.lock);
+}
+
+void search_index_remove(uint32_t id) {
+    pthread_mutex_lock(&search.lock);
+
+    if(id < search.texts.count) {
+        free(search.texts.items[id]);
+        search.texts.items[id] = NULL;
+        search.replaced.items[id] = true;
+    }
+
+    search.version++;
+    pthread_mutex_unlock(&search.lock);
+}
+
+static void reset_query(void) {
+    da_free(&search.query.folded);
+    free(search.query.buffer);
+    da_free(&search.query.words);
+    free(search.query.heap);
+    da_free(&search.query.matches);
+    memset(&search.query, 0, sizeof(search.query));
+}
+
+void search_index_clear(void) {
+    pthread_mutex_lock(&search.lock);
+
+    for(size_t i = 0; i < search.texts.count; i++) free(search.texts.items[i]);
+    for(size_t i = 0; i < search.lists.count; i++) {
+        da_free(&search.lists.items[i]);
+        free(search.lists.items[i].scores);
+    }
+    da_free(&search.texts);
+    da_free(&search.signatures);
+    da_free(&search.replaced);
+    da_free(&search.lists);
+    free(search.prefixes.keys);
+    free(search.prefixes.lists);
+    da_free(&search.lastQuery);
+    da_free(&search.candidates);
+    free(search.stamps);
+
+    memset(&search.texts, 0, sizeof(search.texts));
+    memset(&search.signatures, 0, sizeof(search.signatures));
+    memset(&search.replaced, 0, sizeof(search.replaced));
+    memset(&search.lists, 0, sizeof(search.lists));
+    memset(&search.prefixes, 0, sizeof(search.prefixes));
+    memset(&search.lastQuery, 0, sizeof(search.lastQuery));
+    memset(&search.candidates, 0, sizeof(search.candidates));
+    search.stamps = NULL;
+    search.stampsCount = 0;
+    reset_query();
+    search.version++;
+
+    pthread_mutex_unlock(&search.lock);
+}
+
+// every word has to be the start of a word of the text, returns the score or -1
+static int match_text(const char *text, char **words, size_t wordsCount) {
+    int score = 0;
+
+    for(size_t i = 0; i < wordsCount; i++) {
+        size_t length = strlen(words[i]);
+        int best = -1;
+
+        for(const char *p = strstr(text, words[i]); p != NULL; p = strstr(p + 1, words[i])) {
+            if(!is_word_start(text, p)) continue;
+            int wordScore = score_word(text, p, length);
+            if(wordScore > best) best = wordScore;
+        }
+
+        if(best < 0) return -1;
+        score += best;
+    }
+
+    return score;
+}
+
+static bool is_worse_match(SearchMatch a, SearchMatch b) {
+    return a.score < b.score || (a.score == b.score && a.id > b.id);
+}
+
+// min-heap of the best matches, the root is the worst one kept
+static void push_match(SearchMatch *heap, size_t *count, SearchMatch match) {
+    size_t i;
+
+    if(*count < SEARCH_MAX_RESULTS) {
+        i = (*count)++;
+        while(i > 0 && is_worse_match(match, heap[(i - 1) / 2])) {
+            heap[i] = heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        heap[i] = match;
+        return;
+    }
+
+    if(!is_worse_match(heap[0], match)) return;
+
+    i = 0;
+    while(true) {
+        size_t child = i * 2 + 1;
+        if(child >= *count) break;
+        if(child + 1 < *count && is_worse_match(heap[child + 1], heap[child])) child++;
+        if(!is_worse_match(heap[child], match)) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = match;
+}
+
+static int compare_matches(const void *a, const void *b) {
+    SearchMatch ma = *(const SearchMatch*)a;
+    SearchMatch mb = *(const SearchMatch*)b;
+    if(is_worse_match(mb, ma)) return -1;
+    if(is_worse_match(ma, mb)) return 1;
+    return 0;
+}
+
+// the shortest posting list among the words, NULL when a word has none so nothing can match
+static const PostingList *get_candidates_list(char **words, size_t wordsCount) {
+    const PostingList *shortest = NULL;
+
+    for(size_t i = 0; i < wordsCount; i++) {
+        size_t length = strlen(words[i]);
+        if(length > SEARCH_PREFIX_LENGTH) length = SEARCH_PREFIX_LENGTH;
+
+        const PostingList *list = get_prefix_list(get_prefix_key(words[i], length));
+        if(list == NULL) return NULL;
+        if(shortest == NULL || list->count < shortest->count) shortest = list;
+    }
+
+    return shortest;
+}
+
+static void start_query(StringBuilder folded) {
+    reset_query();
+
+    SearchQuery *query = &search.query;
+    query->active = true;
+    query->folded = folded;
+    query->version = search.version;
+
+    // words only get longer or more of them, so the matches of the last query contain the new ones
+    query->refine = search.lastVersion == search.version && search.lastQuery.count > 1
+        && strncmp(folded.items, search.lastQuery.items, search.lastQuery.count - 1) == 0;
+
+    query->buffer = strdup(folded.items);
+    char *state;
+    for(char *word = strtok_r(query->buffer, " ", &state); word != NULL; word = strtok_r(NULL, " ", &state)) {
+        da_append(&query->words, word);
+    }
+
+    query->heap = malloc(SEARCH_MAX_RESULTS * sizeof(SearchMatch));
+
+    if(search.stampsCount < search.texts.count) {
+        search.stamps = realloc(search.stamps, search.texts.count * sizeof(uint32_t));
+        memset(search.stamps + search.stampsCount, 0, (search.texts.count - search.stampsCount) * sizeof(uint32_t));
+        search.stampsCount = search.texts.count;
+    }
+
+    if(++search.stamp == 0) {
+        memset(search.stamps, 0, search.stampsCount * sizeof(uint32_t));
+        search.stamp = 1;
+    }
+}
+
+// checks the candidates until SEARCH_QUERY_CHECKS texts were matched, returns true once all were
+static bool continue_query(void) {
+    SearchQuery *query = &search.query;
+    if(query->words.count == 0) return true;
+
+    const PostingList *list = get_candidates_list(query->words.items, query->words.count);
+    if(list == NULL) return true;
+
+    // a word as short as the prefixes has its exact matches and their scores in the list, only the
+    // replaced tracks are checked. Otherwise both are a superset of the matches, the shortest one is checked
+    const uint32_t *ids = list->items;
+    const uint8_t *scores = NULL;
+    size_t count = list->count;
+
+    if(query->words.count == 1 && strlen(query->words.items[0]) <= SEARCH_PREFIX_LENGTH) {
+        scores = list->scores;
+    } else if(query->refine && search.candidates.count < list->count) {
+        ids = search.candidates.items;
+        count = search.candidates.count;
+    }
+
+    size_t checks = 0;
+
+    for(; query->next < count; query->next++) {
+        uint32_t id = ids[query->next];
+        if(id >= search.texts.count) continue;
+
+        // the ids that were never replaced are only once in a list
+        int score;
+        if(scores != NULL && !search.replaced.items[id]) {
+            score = scores[query->next];
+        } else {
+            const char *text = search.texts.items[id];
+            if(text == NULL || search.stamps[id] == search.stamp) continue;
+            if(checks == SEARCH_QUERY_CHECKS) return false;
+
+            score = match_text(text, query->words.items, query->words.count);
+            search.stamps[id] = search.stamp;
+            checks++;
+        }
+
+        if(score < 0) continue;
+
+        da_append(&query->matches, id);
+        push_match(query->heap, &query->heapCount, (SearchMatch){id, score});
+    }
+
+    return true;
+}
+
+static void finish_query(SearchResults *results) {
+    SearchQuery *query = &search.query;
+
+    qsort(query->heap, query->heapCount, sizeof(SearchMatch), compare_matches);
+    results->ids.count = 0;
+    for(size_t i = 0; i < query->heapCount; i++) da_append(&results->ids, query->heap[i].id);
+    results->total = query->matches.count;
+
+    da_free(&search.lastQuery);
+    search.lastQuery = query->folded;
+    search.lastVersion = query->version;
+    da_free(&search.candidates);
+    search.candidates = query->matches;
+
+    memset(&query->folded, 0, sizeof(query->folded));
+    memset(&query->matches, 0, sizeof(query->matches));
+    reset_query();
+}
+
+bool search_query(const char *query, SearchResults *results) {
+    StringBuilder folded = {0};
+    fold_text(&folded, query);
+    da_append(&folded, '\0');
+
+    if(pthread_mutex_trylock(&search.lock) != 0) {
+        da_free(&folded);
+        return false;
+    }
+
+    // the same query continues where it stopped in the last frame
+    if(search.query.active && search.query.version == search.version && strcmp(folded.items, search.query.folded.items) == 0) {
+        da_free(&folded);
+    } else {
+        start_query(folded);
+    }
+
+    bool done = continue_query();
+    if(done) finish_query(results);
+
+    pthread_mutex_unlock(&search.lock);
+    return done;
+}
+
+// every error costs more than the difference between two fields
+static bool fuzzy_match_text(const char *text, uint64_t signature, const FuzzyPattern *patterns, size_t patternsCount, int *score) {
+    for(size_t i = 0; i < patternsCount; i++) {
+        if(!fuzzy_may_match(&patterns[i], signature)) return false;
+    }
+
+    *score = 0;
+
+    for(size_t i = 0; i < patternsCount; i++) {
+        size_t end;
+        int distance = fuzzy_match(&patterns[i], text, &end);
+        if(distance < 0) return false;
+        *score += get_field_score(text, text + end - 1) - distance * 32;
+    }
+
+    return true;
+}
+
+static bool is_fuzzy_cancelled(void) {
+    pthread_mutex_lock(&search.fuzzyLock);
+    bool cancelled = search.fuzzyQuery != NULL || search.fuzzyQuit;
+    pthread_mutex_unlock(&search.fuzzyLock);
+    return cancelled;
+}
+
+// scores every text, returns false when a newer query arrived before the end
+static bool run_fuzzy_query(const char *query, SearchResults *results) {
+    StringBuilder folded = {0};
+    fold_text(&folded, query);
+    da_append(&folded, '\0');
+
+    struct {
+        FuzzyPattern *items;
+        size_t count;
+        size_t capacity;
+    } patterns = {0};
+
+    char *state;
+    for(char *word = strtok_r(folded.items, " ", &state); word != NULL; word = strtok_r(NULL, " ", &state)) {
+        da_append(&patterns, ((FuzzyPattern){0}));
+        fuzzy_compile(&patterns.items[patterns.count - 1], word, strlen(word));
+    }
+
+    SearchMatch *heap = malloc(SEARCH_MAX_RESULTS * sizeof(SearchMatch));
+    size_t heapCount = 0;
+    bool cancelled = false;
+
+    for(size_t start = 0; patterns.count > 0; start += SEARCH_FUZZY_CHUNK) {
+        if(is_fuzzy_cancelled()) {
+            cancelled = true;
+            break;
+        }
+
+        pthread_mutex_lock(&search.lock);
+
+        size_t end = start + SEARCH_FUZZY_CHUNK;
+        bool last = end >= search.texts.count;
+        if(last) end = search.texts.count;
+
+        for(size_t id = start; id < end; id++) {
+            const char *text = search.texts.items[id];
+            if(text == NULL) continue;
+
+            int score;
+            if(!fuzzy_match_text(text, search.signatures.items[id], patterns.items, patterns.count, &score)) continue;
+
+            results->total++;
+            push_match(heap, &heapCount, (SearchMatch){id, score});
+        }
+
+        pthread_mutex_unlock(&search.lock);
+        if(last) break;
+    }
+
+    qsort(heap, heapCount, sizeof(SearchMatch), compare_matches);
+    for(size_t i = 0; i < heapCount; i++) da_append(&results->ids, heap[i].id);
+
+    free(heap);
+    da_free(&patterns);
+    da_free(&folded);
+    return !cancelled;
+}
+
+static void *fuzzy_thread(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&search.fuzzyLock);
+
+    while(true) {
+        while(search.fuzzyQuery == NULL && !search.fuzzyQuit) {
+            pthread_cond_wait(&search.fuzzyCond, &search.fuzzyLock);
+        }
+
+        if(search.fuzzyQuit) break;
+
+        char *query = search.fuzzyQuery;
+        unsigned int generation = search.fuzzyGeneration;
+        search.fuzzyQuery = NULL;
+
+        pthread_mutex_unlock(&search.fuzzyLock);
+        SearchResults results = {0};
+        bool done = run_fuzzy_query(query, &results);
+        free(query);
+        pthread_mutex_lock(&search.fuzzyLock);
+
+        if(done && generation == search.fuzzyGeneration) {
+            da_free(&search.fuzzyResults.ids);
+            search.fuzzyResults = results;
+            search.fuzzyReady = true;
+        } else {
+            da_free(&results.ids);
+        }
+    }
+
+    pthread_mutex_unlock(&search.fuzzyLock);
+    return NULL;
+}
+
+void search_init(void) {
+    search.fuzzyQuit = false;
+
+    if(pthread_create(&search.fuzzyThread, NULL, fuzzy_thread, NULL) != 0) {
+        log_error("Failed to start the fuzzy search thread (%s)", "pthread_create");
+        return;
+    }
+
+    search.fuzzyRunning = true;
+}
+
+void search_close(void) {
+    if(search.fuzzyRunning) {
+        pthread_mutex_lock(&search.fuzzyLock);
+        search.fuzzyQuit = true;
+        pthread_cond_signal(&search.fuzzyCond);
+        pthread_mutex_unlock(&search.fuzzyLock);
+
+        pthread_join(search.fuzzyThread, NULL);
+        search.fuzzyRunning = false;
+    }
+
+    free(search.fuzzyQuery);
+    search.fuzzyQuery = NULL;
+    da_free(&search.fuzzyResults.ids);
+    memset(&search.fuzzyResults, 0, sizeof(search.fuzzyResults));
+    search.fuzzyReady = false;
+
+    search_index_clear();
+}
+
+void search_fuzzy_request(const char *query) {
+    pthread_mutex_lock(&search.fuzzyLock);
+
+    free(search.fuzzyQuery);
+    search.fuzzyQuery = strdup(query);
+    search.fuzzyGeneration++;
+    search.fuzzyReady = false;
+    pthread_cond_signal(&search.fuzzyCond);
+
+    pthread_mutex_unlock(&search.fuzzyLock);
+}
+
+bool search_fuzzy_poll(SearchResults *results) {
+    if(pthread_mutex_trylock(&search.fuzzyLock) != 0) return false;
+
+    bool ready = search.fuzzyReady;
+
+    if(ready) {
+        da_free(&results->ids);
+        *results = search.fuzzyResults;
+        memset(&search.fuzzyResults, 0, sizeof(search.fuzzyResults));
+        search.fuzzyReady = false;
+    }
+
+    pthread_mutex_unlock(&search.fuzzyLock);
+    return ready;
+}
@@ -0,0 +1,48 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Type-ahead index over the folded title, artist, album and genre of the library tracks (see text.h).
+// Every word of the query has to be the start of a word of the track, in any field and order. The
+// candidates come from the posting list of the first 3 bytes of a query word, and when the query only
+// adds characters to the previous one, from the previous matches. A single word as short as the prefixes
+// is answered from its posting list and the scores stored in it. The library keeps it updated as
+// tracks are added and removed.
+//
+// The fuzzy search scores every track on its own thread with a bounded edit distance (see fuzzy.h), for
+// misspelled names that the type-ahead search doesn't find. A new request cancels the running one.
+
+#define SEARCH_MAX_RESULTS 500
+
+typedef struct {
+    struct {
+        uint32_t *items; // library track ids, best match first
+        size_t count;
+        size_t capacity;
+    } ids;
+    size_t total; // matches before keeping the best SEARCH_MAX_RESULTS
+} SearchResults;
+
+// start and stop the fuzzy search thread, search_close clears the index too
+void search_init(void);
+void search_close(void);
+
+// the strings are folded and copied, adding an id again replaces its entry
+void search_index_add(uint32_t id, const char *title, const char *artist, const char *album, const char *genre);
+void search_index_remove(uint32_t id);
+void search_index_clear(void);
+
+// returns false without waiting when the index is being updated or when the candidates of the query take more
+// than a frame to check, the query can be retried in the next frame and continues where it stopped
+// the results can contain ids that were just removed from the library, library_find_id tells which ones
+bool search_query(const char *query, SearchResults *results);
+
+// scores the whole library for the query on the fuzzy thread, the results of older requests are dropped
+void search_fuzzy_request(const char *query);
+// returns true once when the results of the last request are ready, the old ids of results are freed
+bool search_fuzzy_poll(SearchResults *results);
+
+#endif // SEARCH_H
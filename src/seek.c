@@ -0,0 +1,415 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "CCFuncs.h"
+#include "seek.h"
+#include "mp3.h"
+#include "decoder.h"
+
+// raudio keeps the dr_mp3 decoder of a mp3 music in Music.ctxData, dr_mp3 is linked inside libraylib.a
+
+typedef struct drmp3 drmp3;
+unsigned int drmp3_bind_seek_table(drmp3 *mp3, unsigned int seekPointCount, Mp3SeekPoint *seekPoints);
+
+#define SEEK_INDEX_CACHE_SIZE 8
+#define SEEK_INDEX_READ_CHUNK (64 * 1024)
+// an exact point every 16 frames, ~0.4s for MPEG-1 layer III
+#define SEEK_INDEX_FRAMES_PER_POINT 16
+// how many frames before a point we can start decoding to fill the bit reservoir
+#define SEEK_INDEX_MAX_LEAD 8
+#define SEEK_INDEX_RESYNC_LIMIT (64 * 1024)
+#define MP3_MAX_BIT_RESERVOIR 511
+
+static struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool running;
+    bool quit;
+
+    struct {
+        char **items; // files waiting for the scan
+        size_t count;
+        size_t capacity;
+    } requests;
+
+    struct {
+        SeekIndex **items; // finished scans waiting for seek_index_poll
+        size_t count;
+        size_t capacity;
+    } done;
+
+    SeekIndex *cache[SEEK_INDEX_CACHE_SIZE];
+    unsigned long long cacheUse[SEEK_INDEX_CACHE_SIZE];
+    unsigned long long useCounter;
+} seeker = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+// bytes of the previous frames used by the frame, only layer III has a bit reservoir
+static int get_main_data_begin(const unsigned char *frame, const Mp3FrameHeader *header) {
+    if(header->layer != 3) return 0;
+    const unsigned char *side = frame + header->sideInfoStart;
+    return header->lsf ? side[0] : (side[0] << 1 | side[1] >> 7);
+}
+
+static int get_main_data_size(const Mp3FrameHeader *header) {
+    return header->length - header->sideInfoStart - header->sideInfoSize;
+}
+
+typedef struct {
+    FILE *fp;
+    long long fileSize;
+    unsigned char *buffer;
+    long long start; // file offset of buffer[0]
+    size_t count;
+} FileReader;
+
+// makes [offset, offset + size) available in the buffer, returns NULL past the end of the file
+static const unsigned char *reader_get(FileReader *reader, long long offset, size_t size) {
+    if(offset < reader->start || offset + (long long)size > reader->start + (long long)reader->count) {
+        if(fseek(reader->fp, offset, SEEK_SET) != 0) return NULL;
+        reader->start = offset;
+        reader->count = fread(reader->buffer, 1, SEEK_INDEX_READ_CHUNK, reader->fp);
+        if((long long)size > (long long)reader->count) return NULL;
+    }
+    return reader->buffer + (offset - reader->start);
+}
+
+// a frame is only trusted when the next one is right where its length says
+static bool find_mp3_frame(FileReader *reader, long long *offset, const Mp3FrameHeader *reference, Mp3FrameHeader *header) {
+    long long limit = *offset + SEEK_INDEX_RESYNC_LIMIT;
+
+    for(long long pos = *offset; pos < limit; pos++) {
+        const unsigned char *p = reader_get(reader, pos, MP3_HEADER_SIZE);
+        if(p == NULL) return false;
+        if(!parse_mp3_header(p, header)) continue;
+        if(reference != NULL && !same_mp3_stream(reference, header)) continue;
+
+        Mp3FrameHeader next;
+        const unsigned char *q = reader_get(reader, pos + header->length, MP3_HEADER_SIZE);
+        // the last frame of the file doesn't have a next one
+        bool last = q == NULL && pos + header->length <= reader->fileSize;
+
+        if(last || (q != NULL && parse_mp3_header(q, &next) && same_mp3_stream(header, &next))) {
+            *offset = pos;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static long long skip_id3v2(FileReader *reader) {
+    const unsigned char *p = reader_get(reader, 0, 10);
+    if(p == NULL || memcmp(p, "ID3", 3) != 0) return 0;
+
+    long long size = (p[6] & 0x7f) << 21 | (p[7] & 0x7f) << 14 | (p[8] & 0x7f) << 7 | (p[9] & 0x7f);
+    // footer
+    if(p[5] & 0x10) size += 10;
+    return size + 10;
+}
+
+static bool open_file_reader(const char *filePath, FileReader *reader, long long *modTime) {
+    struct stat st;
+    if(stat(filePath, &st) != 0) return false;
+
+    reader->fp = fopen(filePath, "rb");
+    if(reader->fp == NULL) return false;
+
+    reader->fileSize = st.st_size;
+    reader->buffer = malloc(SEEK_INDEX_READ_CHUNK);
+    reader->start = 0;
+    reader->count = 0;
+    *modTime = st.st_mtime;
+    return true;
+}
+
+static void close_file_reader(FileReader *reader) {
+    fclose(reader->fp);
+    free(reader->buffer);
+}
+
+static SeekIndex *create_seek_index(const char *filePath, FileReader *reader, long long modTime) {
+    SeekIndex *index = calloc(1, sizeof(SeekIndex));
+    index->filePath = strdup(filePath);
+    index->fileSize = reader->fileSize;
+    index->modTime = modTime;
+    index->refs = 1;
+    return index;
+}
+
+static void free_seek_index(SeekIndex *index) {
+    da_free(&index->points);
+    free(index->filePath);
+    free(index);
+}
+
+typedef struct {
+    long long offset;
+    unsigned long long pcmIndex;
+    int mainDataBegin;
+    int mainDataSize;
+} ScannedFrame;
+
+// After a seek dr_mp3 decodes from `seekPosInBytes` until a frame has all its bit reservoir, the frames
+// before it produce nothing. We start one or more frames before the point so the first frame that decodes
+// is at least one frame earlier, this way the overlap and the synthesis filter are already filled at the
+// point and the samples are the same as when decoding from the start.
+static bool make_exact_point(ScannedFrame *frames, int count, Mp3SeekPoint *point) {
+    const ScannedFrame *target = &frames[count - 1];
+
+    for(int start = count - 2; start >= 0; start--) {
+        int reservoir = 0;
+
+        for(int i = start; i < count - 1; i++) {
+            if(reservoir >= frames[i].mainDataBegin) {
+                point->seekPosInBytes = frames[start].offset;
+                point->pcmFrameIndex = target->pcmIndex;
+                point->mp3FramesToDiscard = 1;
+                point->pcmFramesToDiscard = target->pcmIndex - frames[i].pcmIndex;
+                return true;
+            }
+
+            reservoir += frames[i].mainDataSize;
+            if(reservoir > MP3_MAX_BIT_RESERVOIR) reservoir = MP3_MAX_BIT_RESERVOIR;
+        }
+    }
+
+    return false;
+}
+
+static SeekIndex *build_exact_seek_index(const char *filePath) {
+    FileReader reader;
+    long long modTime;
+    if(!open_file_reader(filePath, &reader, &modTime)) return NULL;
+
+    long long offset = skip_id3v2(&reader);
+    Mp3FrameHeader first;
+
+    if(!find_mp3_frame(&reader, &offset, NULL, &first)) {
+        close_file_reader(&reader);
+        return NULL;
+    }
+
+    SeekIndex *index = create_seek_index(filePath, &reader, modTime);
+
+    // the last frames, the newest at the end
+    ScannedFrame window[SEEK_INDEX_MAX_LEAD + 1];
+    int windowCount = 0;
+    unsigned long long frameIndex = 0;
+    unsigned long long pcmIndex = 0;
+    Mp3FrameHeader header = first;
+
+    while(offset + header.length <= reader.fileSize) {
+        const unsigned char *frame = reader_get(&reader, offset, header.sideInfoStart + header.sideInfoSize);
+        if(frame == NULL) break;
+
+        ScannedFrame scanned = {
+            .offset = offset,
+            .pcmIndex = pcmIndex,
+            .mainDataBegin = get_main_data_begin(frame, &header),
+            .mainDataSize = get_main_data_size(&header),
+        };
+
+        if(windowCount == SEEK_INDEX_MAX_LEAD + 1) {
+            memmove(window, window + 1, sizeof(ScannedFrame) * SEEK_INDEX_MAX_LEAD);
+            windowCount--;
+        }
+        window[windowCount++] = scanned;
+
+        Mp3SeekPoint point;
+        if(frameIndex > 0 && frameIndex % SEEK_INDEX_FRAMES_PER_POINT == 0 && make_exact_point(window, windowCount, &point)) {
+            da_append(&index->points, point);
+        }
+
+        frameIndex++;
+        pcmIndex += header.samples;
+        offset += header.length;
+
+        const unsigned char *next = reader_get(&reader, offset, MP3_HEADER_SIZE);
+        if(next == NULL) break;
+
+        if(!parse_mp3_header(next, &header) || !same_mp3_stream(&first, &header)) {
+            // ID3v1, APE or garbage, a valid frame after it continues the stream
+            if(memcmp(next, "TAG", 3) == 0 || !find_mp3_frame(&reader, &offset, &first, &header)) break;
+        }
+    }
+
+    close_file_reader(&reader);
+    return index;
+}
+
+static bool seek_index_matches(const SeekIndex *index, const char *filePath, long long fileSize, long long modTime) {
+    return index->fileSize == fileSize && index->modTime == modTime && strcmp(index->filePath, filePath) == 0;
+}
+
+// the lock has to be held
+static SeekIndex *cache_find(const char *filePath) {
+    struct stat st;
+    if(stat(filePath, &st) != 0) return NULL;
+
+    for(int i = 0; i < SEEK_INDEX_CACHE_SIZE; i++) {
+        SeekIndex *index = seeker.cache[i];
+        if(index != NULL && seek_index_matches(index, filePath, st.st_size, st.st_mtime)) {
+            seeker.cacheUse[i] = ++seeker.useCounter;
+            return index;
+        }
+    }
+
+    return NULL;
+}
+
+// the lock has to be held, the cache keeps its own reference
+static void cache_insert(SeekIndex *index) {
+    int slot = 0;
+    for(int i = 0; i < SEEK_INDEX_CACHE_SIZE; i++) {
+        if(seeker.cache[i] == NULL) {
+            slot = i;
+            break;
+        }
+        if(seeker.cacheUse[i] < seeker.cacheUse[slot]) slot = i;
+    }
+
+    SeekIndex *evicted = seeker.cache[slot];
+    if(evicted != NULL && --evicted->refs == 0) free_seek_index(evicted);
+
+    index->refs++;
+    seeker.cache[slot] = index;
+    seeker.cacheUse[slot] = ++seeker.useCounter;
+}
+
+static void *seek_index_worker(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&seeker.lock);
+
+    while(true) {
+        while(seeker.requests.count == 0 && !seeker.quit) {
+            pthread_cond_wait(&seeker.cond, &seeker.lock);
+        }
+
+        if(seeker.quit) break;
+
+        char *filePath = seeker.requests.items[0];
+        seeker.requests.count--;
+        memmove(seeker.requests.items, seeker.requests.items + 1, seeker.requests.count * sizeof(char*));
+
+        pthread_mutex_unlock(&seeker.lock);
+        SeekIndex *index = build_exact_seek_index(filePath);
+        free(filePath);
+        pthread_mutex_lock(&seeker.lock);
+
+        if(index != NULL) {
+            cache_insert(index);
+            da_append(&seeker.done, index);
+        }
+    }
+
+    pthread_mutex_unlock(&seeker.lock);
+    return NULL;
+}
+
+void seek_index_init(void) {
+    seeker.quit = false;
+
+    if(pthread_create(&seeker.thread, NULL, seek_index_worker, NULL) != 0) {
+        log_error("Failed to start the seek index thread (%s)", "pthread_create");
+        return;
+    }
+
+    seeker.running = true;
+}
+
+void seek_index_close(void) {
+    if(!seeker.running) return;
+
+    pthread_mutex_lock(&seeker.lock);
+    seeker.quit = true;
+    pthread_cond_signal(&seeker.cond);
+    pthread_mutex_unlock(&seeker.lock);
+
+    pthread_join(seeker.thread, NULL);
+    seeker.running = false;
+
+    for(size_t i = 0; i < seeker.requests.count; i++) free(seeker.requests.items[i]);
+    for(size_t i = 0; i < seeker.done.count; i++) release_seek_index(seeker.done.items[i]);
+    da_free(&seeker.requests);
+    da_free(&seeker.done);
+    memset(&seeker.requests, 0, sizeof(seeker.requests));
+    memset(&seeker.done, 0, sizeof(seeker.done));
+
+    for(int i = 0; i < SEEK_INDEX_CACHE_SIZE; i++) {
+        if(seeker.cache[i] != NULL) release_seek_index(seeker.cache[i]);
+        seeker.cache[i] = NULL;
+    }
+}
+
+SeekIndex *get_cached_seek_index(const char *filePath) {
+    pthread_mutex_lock(&seeker.lock);
+    SeekIndex *index = cache_find(filePath);
+    if(index != NULL) index->refs++;
+    pthread_mutex_unlock(&seeker.lock);
+
+    return index;
+}
+
+SeekIndex *get_seek_index(Music music, const char *filePath) {
+    if(music.ctxType != RAUDIO_CONTEXT_MP3) return NULL;
+
+    SeekIndex *index = get_cached_seek_index(filePath);
+    if(index != NULL) return index;
+
+    pthread_mutex_lock(&seeker.lock);
+
+    bool queued = false;
+    for(size_t i = 0; i < seeker.requests.count && !queued; i++) {
+        queued = strcmp(seeker.requests.items[i], filePath) == 0;
+    }
+
+    if(!queued) {
+        da_append(&seeker.requests, strdup(filePath));
+        pthread_cond_signal(&seeker.cond);
+    }
+
+    pthread_mutex_unlock(&seeker.lock);
+
+    return NULL;
+}
+
+SeekIndex *seek_index_poll(void) {
+    SeekIndex *index = NULL;
+
+    if(pthread_mutex_trylock(&seeker.lock) != 0) return NULL;
+
+    if(seeker.done.count > 0) {
+        index = seeker.done.items[0];
+        seeker.done.count--;
+        memmove(seeker.done.items, seeker.done.items + 1, seeker.done.count * sizeof(SeekIndex*));
+    }
+
+    pthread_mutex_unlock(&seeker.lock);
+    return index;
+}
+
+void release_seek_index(SeekIndex *index) {
+    pthread_mutex_lock(&seeker.lock);
+    bool unused = --index->refs == 0;
+    pthread_mutex_unlock(&seeker.lock);
+
+    if(unused) free_seek_index(index);
+}
+
+void bind_seek_index(Music music, SeekIndex *index) {
+    if(music.ctxType != RAUDIO_CONTEXT_MP3 || music.ctxData == NULL) return;
+
+    if(index == NULL) {
+        drmp3_bind_seek_table(music.ctxData, 0, NULL);
+    } else {
+        drmp3_bind_seek_table(music.ctxData, index->points.count, index->points.items);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef SEEK_H
+#define SEEK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "raylib.h"
+
+// same layout as drmp3_seek_point
+typedef struct {
+    uint64_t seekPosInBytes;     // first byte of the mp3 frame where decoding starts
+    uint64_t pcmFrameIndex;      // pcm frame the point refers to
+    uint16_t mp3FramesToDiscard; // frames decoded before reaching the point
+    uint16_t pcmFramesToDiscard; // pcm frames decoded before `pcmFrameIndex`
+} Mp3SeekPoint;
+
+// Maps times to mp3 frames so SeekMusicStream doesn't decode from the start of the file. The table comes
+// from a scan of every frame header done in a background thread, until then dr_mp3 seeks by decoding from
+// the start. The Xing/VBRI TOC isn't used: its points land on frames whose pcm index can only be guessed,
+// and a wrong index leaves the decoder somewhere else than the position of the track. The tables are
+// cached by path, size and modification time.
+typedef struct {
+    char *filePath;
+    long long fileSize;
+    long long modTime;
+    int refs;
+
+    struct {
+        Mp3SeekPoint *items;
+        size_t count;
+        size_t capacity;
+    } points;
+} SeekIndex;
+
+void seek_index_init(void);
+void seek_index_close(void);
+
+// returns the cached index, NULL if the music isn't a mp3 or it wasn't scanned yet
+// without an index a scan is queued, its result will be returned by seek_index_poll
+SeekIndex *get_seek_index(Music music, const char *filePath);
+
+// returns the index if it's in the cache, NULL otherwise
+SeekIndex *get_cached_seek_index(const char *filePath);
+
+// returns the next index finished by the background scan or NULL
+SeekIndex *seek_index_poll(void);
+
+void release_seek_index(SeekIndex *index);
+
+// makes the mp3 decoder of the music use the index, it has no effect on other formats
+// the decoder can't be in use by another thread and the index has to outlive the music
+void bind_seek_index(Music music, SeekIndex *index);
+
+#endif // SEEK_H
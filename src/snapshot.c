@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "CCFuncs.h"
+#include "snapshot.h"
+
+#define SNAPSHOT_MAGIC "CMUSICLB"
+#define SNAPSHOT_DIR "c-music"
+#define SNAPSHOT_FILE "library.bin"
+
+typedef struct {
+    size_t field; // offset of the pointer in SnapshotColumns
+    size_t size; // of an element
+    bool isString; // the elements are ids in the strings
+} ColumnInfo;
+
+static const ColumnInfo columnsInfo[] = {
+    {offsetof(SnapshotColumns, id), sizeof(uint32_t), false},
+    {offsetof(SnapshotColumns, filePath), sizeof(uint32_t), true},
+    {offsetof(SnapshotColumns, title), sizeof(uint32_t), true},
+    {offsetof(SnapshotColumns, artist), sizeof(uint32_t), true},
+    {offsetof(SnapshotColumns, album), sizeof(uint32_t), true},
+    {offsetof(SnapshotColumns, genre), sizeof(uint32_t), true},
+    {offsetof(SnapshotColumns, titleKey), sizeof(uint32_t), true},
+    {offsetof(SnapshotColumns, artistKey), sizeof(uint32_t), true},
+    {offsetof(SnapshotColumns, albumKey), sizeof(uint32_t), true},
+    {offsetof(SnapshotColumns, nameKey), sizeof(uint32_t), true},
+    {offsetof(SnapshotColumns, duration), sizeof(float), false},
+    {offsetof(SnapshotColumns, coverHash), sizeof(uint32_t), false},
+    {offsetof(SnapshotColumns, modTime), sizeof(int64_t), false},
+    {offsetof(SnapshotColumns, fileSize), sizeof(int64_t), false},
+};
+
+#define SNAPSHOT_COLUMNS_COUNT (sizeof(columnsInfo) / sizeof(columnsInfo[0]))
+#define SNAPSHOT_ALIGN(x) (((x) + 7) & ~(uint64_t)7)
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t columnsCount; // a different layout is rejected like a different version
+    uint64_t tracksCount;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint64_t columnOffsets[SNAPSHOT_COLUMNS_COUNT];
+} SnapshotHeader;
+
+static const void **get_column(SnapshotColumns *columns, const ColumnInfo *info) {
+    return (const void**)((char*)columns + info->field);
+}
+
+bool open_snapshot(const char *filePath, Snapshot *snapshot) {
+    memset(snapshot, 0, sizeof(Snapshot));
+
+    int fd = open(filePath, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(data == MAP_FAILED) {
+        log_error("Failed to map the library snapshot %s", filePath);
+        return false;
+    }
+
+    size_t size = st.st_size;
+    const SnapshotHeader *header = data;
+    SnapshotColumns *columns = &snapshot->columns;
+
+    bool valid = memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) == 0
+        && header->version == SNAPSHOT_VERSION
+        && header->columnsCount == SNAPSHOT_COLUMNS_COUNT
+        && header->stringsOffset <= size
+        && header->stringsSize <= size - header->stringsOffset
+        && header->stringsSize > 0
+        && header->stringsSize <= UINT32_MAX;
+
+    for(size_t i = 0; valid && i < SNAPSHOT_COLUMNS_COUNT; i++) {
+        uint64_t offset = header->columnOffsets[i];
+        valid = offset % 8 == 0 && offset <= size && header->tracksCount <= (size - offset) / columnsInfo[i].size;
+        if(valid) *get_column(columns, &columnsInfo[i]) = (const char*)data + offset;
+    }
+
+    const char *strings = (const char*)data + header->stringsOffset;
+
+    // with a null at both ends, every id inside the strings is a valid string and 0 is ""
+    if(valid) valid = strings[0] == '\0' && strings[header->stringsSize - 1] == '\0';
+
+    for(size_t i = 0; valid && i < SNAPSHOT_COLUMNS_COUNT; i++) {
+        if(!columnsInfo[i].isString) continue;
+
+        const uint32_t *ids = *get_column(columns, &columnsInfo[i]);
+        for(size_t j = 0; valid && j < header->tracksCount; j++) valid = ids[j] < header->stringsSize;
+    }
+
+    if(!valid) {
+        log_error("The library snapshot %s is invalid or from another version", filePath);
+        munmap(data, size);
+        memset(snapshot, 0, sizeof(Snapshot));
+        return false;
+    }
+
+    snapshot->data = data;
+    snapshot->size = size;
+    columns->tracksCount = header->tracksCount;
+    columns->strings = strings;
+    columns->stringsSize = header->stringsSize;
+    return true;
+}
+
+void close_snapshot(Snapshot *snapshot) {
+    if(snapshot->data != NULL) munmap(snapshot->data, snapshot->size);
+    memset(snapshot, 0, sizeof(Snapshot));
+}
+
+static bool write_padding(FILE *fp, uint64_t *offset) {
+    static const char zeros[8] = {0};
+    uint64_t padding = SNAPSHOT_ALIGN(*offset) - *offset;
+    *offset += padding;
+    return fwrite(zeros, 1, padding, fp) == padding;
+}
+
+bool write_snapshot(const char *filePath, const SnapshotColumns *columns) {
+    SnapshotHeader header = {
+        .version = SNAPSHOT_VERSION,
+        .columnsCount = SNAPSHOT_COLUMNS_COUNT,
+        .tracksCount = columns->tracksCount,
+        .stringsSize = columns->stringsSize,
+    };
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+
+    uint64_t offset = SNAPSHOT_ALIGN(sizeof(SnapshotHeader));
+    for(size_t i = 0; i < SNAPSHOT_COLUMNS_COUNT; i++) {
+        header.columnOffsets[i] = offset;
+        offset = SNAPSHOT_ALIGN(offset + columns->tracksCount * columnsInfo[i].size);
+    }
+    header.stringsOffset = offset;
+
+    char tmpPath[4096];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", filePath);
+
+    FILE *fp = fopen(tmpPath, "wb");
+    if(fp == NULL) {
+        log_error("Failed to write the library snapshot %s", filePath);
+        return false;
+    }
+
+    offset = sizeof(SnapshotHeader);
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 && write_padding(fp, &offset);
+
+    for(size_t i = 0; ok && i < SNAPSHOT_COLUMNS_COUNT; i++) {
+        const void *column = *get_column((SnapshotColumns*)columns, &columnsInfo[i]);
+        size_t size = columns->tracksCount * columnsInfo[i].size;
+
+        ok = fwrite(column, 1, size, fp) == size;
+        offset += size;
+        ok = ok && write_padding(fp, &offset);
+    }
+
+    ok = ok && fwrite(columns->strings, 1, columns->stringsSize, fp) == columns->stringsSize;
+    ok = fclose(fp) == 0 && ok;
+    ok = ok && rename(tmpPath, filePath) == 0;
+
+    if(!ok) {
+        log_error("Failed to write the library snapshot %s", filePath);
+        unlink(tmpPath);
+    }
+
+    return ok;
+}
+
+char *get_cache_dir(void) {
+    const char *cacheHome = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char dir[4096];
+
+    if(cacheHome != NULL && cacheHome[0] != '\0') {
+        snprintf(dir, sizeof(dir), "%s/%s", cacheHome, SNAPSHOT_DIR);
+    } else if(home != NULL && home[0] != '\0') {
+        snprintf(dir, sizeof(dir), "%s/.cache", home);
+        mkdir(dir, 0755);
+        snprintf(dir, sizeof(dir), "%s/.cache/%s", home, SNAPSHOT_DIR);
+    } else {
+        return NULL;
+    }
+
+    mkdir(dir, 0755);
+    return strdup(dir);
+}
+
+char *get_snapshot_path(void) {
+    char *dir = get_cache_dir();
+    if(dir == NULL) return NULL;
+
+    char path[4096 + sizeof(SNAPSHOT_FILE) + 1];
+    snprintf(path, sizeof(path), "%s/%s", dir, SNAPSHOT_FILE);
+    free(dir);
+    return strdup(path);
+}
@@ -0,0 +1,57 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary copy of the library that is mmaped on startup and used in place. It has the same columns as the
+// library table and its strings become the read only base of the library string pool, so the string ids
+// don't change. The integers are stored in the native byte order.
+//
+// header | column offsets | columns (8 bytes aligned) | strings (null terminated utf-8)
+
+#define SNAPSHOT_VERSION 3
+
+typedef struct {
+    size_t tracksCount;
+    const uint32_t *id;
+    // ids in the strings
+    const uint32_t *filePath;
+    const uint32_t *title;
+    const uint32_t *artist;
+    const uint32_t *album;
+    const uint32_t *genre;
+    const uint32_t *titleKey;
+    const uint32_t *artistKey;
+    const uint32_t *albumKey;
+    const uint32_t *nameKey;
+    const float *duration;
+    const uint32_t *coverHash;
+    // compared with stat() to know if the file changed since the snapshot was written
+    const int64_t *modTime;
+    const int64_t *fileSize;
+
+    const char *strings;
+    size_t stringsSize;
+} SnapshotColumns;
+
+typedef struct {
+    void *data;
+    size_t size;
+    SnapshotColumns columns;
+} Snapshot;
+
+// maps the file and checks the header, every string id is checked too so the columns can be used directly
+bool open_snapshot(const char *filePath, Snapshot *snapshot);
+void close_snapshot(Snapshot *snapshot);
+
+// writes to a temporary file that replaces the old one, a running process can keep using its mapping
+bool write_snapshot(const char *filePath, const SnapshotColumns *columns);
+
+// $XDG_CACHE_HOME/c-music or ~/.cache/c-music, created if needed, the result is allocated with malloc
+char *get_cache_dir(void);
+// library.bin in the cache directory, the result is allocated with malloc
+char *get_snapshot_path(void);
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,925 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "CCFuncs.h"
+#include "tags.h"
+#include "mp3.h"
+
+#define ID3V2_HEADER_SIZE 10
+#define ID3V1_SIZE 128
+
+#define ID3V2_FLAG_UNSYNC 0x80
+#define ID3V2_FLAG_EXTENDED_HEADER 0x40
+
+#define ID3_PICTURE_FRONT_COVER 3
+
+#define FLAC_BLOCK_STREAMINFO 0
+#define FLAC_BLOCK_VORBIS_COMMENT 4
+#define FLAC_BLOCK_PICTURE 6
+#define FLAC_BLOCK_LAST 0x80
+
+#define OGG_PAGE_HEADER_SIZE 27
+// the last page is searched in this many bytes from the end of the file
+#define OGG_LAST_PAGE_SEARCH (64 * 1024)
+#define OPUS_SAMPLE_RATE 48000
+
+// bytes read after the ID3v2 tag to find the first mp3 frame
+#define MP3_FIRST_FRAME_SEARCH 4096
+
+// ID3v1 genres including the winamp extensions, the index is the genre number
+static const char *id3Genres[] = {
+    "Blues", "Classic Rock", "Country", "Dance", "Disco", "Funk", "Grunge", "Hip-Hop",
+    "Jazz", "Metal", "New Age", "Oldies", "Other", "Pop", "R&B", "Rap",
+    "Reggae", "Rock", "Techno", "Industrial", "Alternative", "Ska", "Death Metal", "Pranks",
+    "Soundtrack", "Euro-Techno", "Ambient", "Trip-Hop", "Vocal", "Jazz+Funk", "Fusion", "Trance",
+    "Classical", "Instrumental", "Acid", "House", "Game", "Sound Clip", "Gospel", "Noise",
+    "Alternative Rock", "Bass", "Soul", "Punk", "Space", "Meditative", "Instrumental Pop", "Instrumental Rock",
+    "Ethnic", "Gothic", "Darkwave", "Techno-Industrial", "Electronic", "Pop-Folk", "Eurodance", "Dream",
+    "Southern Rock", "Comedy", "Cult", "Gangsta", "Top 40", "Christian Rap", "Pop/Funk", "Jungle",
+    "Native American", "Cabaret", "New Wave", "Psychedelic", "Rave", "Showtunes", "Trailer", "Lo-Fi",
+    "Tribal", "Acid Punk", "Acid Jazz", "Polka", "Retro", "Musical", "Rock & Roll", "Hard Rock",
+    "Folk", "Folk-Rock", "National Folk", "Swing", "Fast Fusion", "Bebob", "Latin", "Revival",
+    "Celtic", "Bluegrass", "Avantgarde", "Gothic Rock", "Progressive Rock", "Psychedelic Rock", "Symphonic Rock", "Slow Rock",
+    "Big Band", "Chorus", "Easy Listening", "Acoustic", "Humour", "Speech", "Chanson", "Opera",
+    "Chamber Music", "Sonata", "Symphony", "Booty Bass", "Primus", "Porn Groove", "Satire", "Slow Jam",
+    "Club", "Tango", "Samba", "Folklore", "Ballad", "Power Ballad", "Rhythmic Soul", "Freestyle",
+    "Duet", "Punk Rock", "Drum Solo", "A Cappella", "Euro-House", "Dance Hall", "Goa", "Drum & Bass",
+    "Club-House", "Hardcore", "Terror", "Indie", "BritPop", "Negerpunk", "Polsk Punk", "Beat",
+    "Christian Gangsta Rap", "Heavy Metal", "Black Metal", "Crossover", "Contemporary Christian", "Christian Rock", "Merengue", "Salsa",
+    "Thrash Metal", "Anime", "JPop", "Synthpop",
+};
+
+#define ID3_GENRES_COUNT (sizeof(id3Genres) / sizeof(id3Genres[0]))
+
+static unsigned int read_u32_be(const unsigned char *p) {
+    return (unsigned int)p[0] << 24 | (unsigned int)p[1] << 16 | (unsigned int)p[2] << 8 | p[3];
+}
+
+static unsigned int read_u32_le(const unsigned char *p) {
+    return (unsigned int)p[3] << 24 | (unsigned int)p[2] << 16 | (unsigned int)p[1] << 8 | p[0];
+}
+
+static unsigned short read_u16_le(const unsigned char *p) {
+    return p[1] << 8 | p[0];
+}
+
+static unsigned long long read_u64_le(const unsigned char *p) {
+    return (unsigned long long)read_u32_le(p + 4) << 32 | read_u32_le(p);
+}
+
+static unsigned int read_u24_be(const unsigned char *p) {
+    return (unsigned int)p[0] << 16 | (unsigned int)p[1] << 8 | p[2];
+}
+
+// sizes in the ID3v2 header (and in the v2.4 frames) only use the lower 7 bits of every byte
+static unsigned int read_syncsafe(const unsigned char *p) {
+    return (p[0] & 0x7f) << 21 | (p[1] & 0x7f) << 14 | (p[2] & 0x7f) << 7 | (p[3] & 0x7f);
+}
+
+// removes the 0x00 inserted after every 0xFF by the unsynchronisation scheme
+// works in place and returns the new size
+static size_t id3_resync(unsigned char *data, size_t size) {
+    size_t j = 0;
+    for(size_t i = 0; i < size; i++) {
+        unsigned char byte = data[i];
+        data[j++] = byte;
+        if(byte == 0xFF && i + 1 < size && data[i + 1] == 0x00) i++;
+    }
+    return j;
+}
+
+// decodes the first string of a text frame (v2.4 can store many separated by null) as utf-8
+// encoding: 0 = ISO-8859-1, 1 = UTF-16 with BOM, 2 = UTF-16BE, 3 = UTF-8
+static char *id3_decode_text(unsigned char encoding, const unsigned char *data, size_t size) {
+    StringBuilder sb = {0};
+
+    if(encoding == 1 || encoding == 2) {
+        bool bigEndian = encoding == 2;
+        size_t i = 0;
+
+        if(encoding == 1 && size >= 2) {
+            if(data[0] == 0xFE && data[1] == 0xFF) {
+                bigEndian = true;
+                i = 2;
+            } else if(data[0] == 0xFF && data[1] == 0xFE) {
+                i = 2;
+            }
+        }
+
+        for(; i + 1 < size; i += 2) {
+            unsigned int unit = bigEndian ? data[i] << 8 | data[i + 1] : data[i + 1] << 8 | data[i];
+            if(unit == 0) break;
+
+            if(unit >= 0xD800 && unit <= 0xDBFF && i + 3 < size) {
+                unsigned int low = bigEndian ? data[i + 2] << 8 | data[i + 3] : data[i + 3] << 8 | data[i + 2];
+                if(low >= 0xDC00 && low <= 0xDFFF) {
+                    unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                    i += 2;
+                }
+            }
+
+            sb_append_utf8(&sb, unit);
+        }
+    } else {
+        for(size_t i = 0; i < size && data[i] != 0; i++) {
+            if(encoding == 3) da_append(&sb, (char)data[i]);
+            else sb_append_utf8(&sb, data[i]);
+        }
+    }
+
+    char *str = sb_dump_str(&sb);
+    da_free(&sb);
+    return str;
+}
+
+// returns the size of a null terminated string including the terminator
+// the terminator is two bytes long in the UTF-16 encodings
+static size_t id3_str_size(unsigned char encoding, const unsigned char *data, size_t size) {
+    if(encoding == 1 || encoding == 2) {
+        for(size_t i = 0; i + 1 < size; i += 2) {
+            if(data[i] == 0 && data[i + 1] == 0) return i + 2;
+        }
+    } else {
+        for(size_t i = 0; i < size; i++) {
+            if(data[i] == 0) return i + 1;
+        }
+    }
+    return size;
+}
+
+static char *id3_genre_name(int genre) {
+    if(genre < 0 || genre >= (int)ID3_GENRES_COUNT) return NULL;
+    return strdup(id3Genres[genre]);
+}
+
+// genres can be stored as "(17)", "(17)Rock" or just "17", we replace the references with the name
+static char *id3_resolve_genre(char *genre) {
+    char *end = NULL;
+
+    if(genre[0] == '(' && genre[1] != '(') {
+        long number = strtol(genre + 1, &end, 10);
+        if(end == genre + 1 || *end != ')') return genre;
+
+        if(end[1] != '\0') {
+            char *refined = strdup(end + 1);
+            free(genre);
+            return refined;
+        }
+
+        char *name = id3_genre_name(number);
+        if(name == NULL) return genre;
+        free(genre);
+        return name;
+    }
+
+    if(genre[0] != '\0') {
+        long number = strtol(genre, &end, 10);
+        if(*end == '\0') {
+            char *name = id3_genre_name(number);
+            if(name == NULL) return genre;
+            free(genre);
+            return name;
+        }
+    }
+
+    return genre;
+}
+
+const char *get_picture_file_type(const unsigned char *data, size_t size) {
+    if(size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF) return ".jpg";
+    if(size >= 4 && memcmp(data, "\x89PNG", 4) == 0) return ".png";
+    if(size >= 2 && memcmp(data, "BM", 2) == 0) return ".bmp";
+    return NULL;
+}
+
+// the first frame header (SOF) of a jpeg has the size, the markers before it are skipped by their length
+static bool get_jpeg_size(const unsigned char *data, size_t size, int *width, int *height) {
+    size_t i = 2;
+
+    while(i + 9 <= size && data[i] == 0xFF) {
+        unsigned char marker = data[i + 1];
+        bool frame = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+
+        if(frame) {
+            *height = data[i + 5] << 8 | data[i + 6];
+            *width = data[i + 7] << 8 | data[i + 8];
+            return true;
+        }
+
+        i += 2 + (data[i + 2] << 8 | data[i + 3]);
+    }
+
+    return false;
+}
+
+bool get_picture_size(const unsigned char *data, size_t size, int *width, int *height) {
+    const char *type = get_picture_file_type(data, size);
+    if(type == NULL) return false;
+
+    if(strcmp(type, ".jpg") == 0) return get_jpeg_size(data, size, width, height);
+
+    // IHDR is always the first chunk
+    if(strcmp(type, ".png") == 0 && size >= 24) {
+        *width = read_u32_be(data + 16);
+        *height = read_u32_be(data + 20);
+        return true;
+    }
+
+    // the height is negative for the top-down bitmaps
+    if(strcmp(type, ".bmp") == 0 && size >= 26) {
+        *width = (int)read_u32_le(data + 18);
+        *height = abs((int)read_u32_le(data + 22));
+        return true;
+    }
+
+    return false;
+}
+
+static void set_tag_str(char **dst, char *value) {
+    if(*dst != NULL || value[0] == '\0') {
+        free(value);
+        return;
+    }
+    *dst = value;
+}
+
+// the picture with the best priority is kept, the front cover wins over the rest
+static void set_tags_cover(MusicTags *tags, int *coverPriority, int pictureType, const unsigned char *data, size_t size) {
+    const char *type = get_picture_file_type(data, size);
+    if(type == NULL) return;
+
+    int priority = pictureType == ID3_PICTURE_FRONT_COVER ? 2 : 1;
+    if(priority <= *coverPriority) return;
+
+    *coverPriority = priority;
+    tags->cover = data;
+    tags->coverSize = size;
+    tags->coverType = type;
+}
+
+// used by the formats where every picture lives in its own buffer
+// takes the ownership of `buffer`, it becomes the tags data when the picture is the one kept
+static void take_tags_cover(MusicTags *tags, int *coverPriority, int pictureType, unsigned char *buffer, const unsigned char *data, size_t size) {
+    const unsigned char *previous = tags->cover;
+    set_tags_cover(tags, coverPriority, pictureType, data, size);
+
+    if(tags->cover == previous) {
+        free(buffer);
+        return;
+    }
+
+    free(tags->data);
+    tags->data = buffer;
+}
+
+// APIC: encoding, mime type, picture type, description, data
+// PIC (v2.2): encoding, image format (3 chars), picture type, description, data
+static void id3_parse_picture(MusicTags *tags, int *coverPriority, bool v22, const unsigned char *data, size_t size) {
+    if(size < 2) return;
+
+    unsigned char encoding = data[0];
+    size_t pos = 1;
+
+    if(v22) {
+        pos += 3;
+    } else {
+        pos += id3_str_size(0, data + pos, size - pos);
+    }
+
+    if(pos >= size) return;
+    int pictureType = data[pos++];
+
+    pos += id3_str_size(encoding, data + pos, size - pos);
+    if(pos >= size) return;
+
+    set_tags_cover(tags, coverPriority, pictureType, data + pos, size - pos);
+}
+
+// COMM: encoding, language, description, text
+// iTunes writes " 00000000 <delay> <padding> <samples> ..." in hexadecimal in the one described as iTunSMPB
+static void id3_parse_comment(MusicTags *tags, const unsigned char *data, size_t size) {
+    if(size < 4) return;
+
+    unsigned char encoding = data[0];
+    size_t descriptionSize = id3_str_size(encoding, data + 4, size - 4);
+    char *description = id3_decode_text(encoding, data + 4, descriptionSize);
+    bool smpb = strcmp(description, "iTunSMPB") == 0;
+    free(description);
+
+    if(!smpb) return;
+
+    size_t pos = 4 + descriptionSize;
+    char *text = id3_decode_text(encoding, data + pos, size - pos);
+
+    unsigned int zero, delay, padding;
+    if(sscanf(text, "%x %x %x", &zero, &delay, &padding) == 3) {
+        tags->trimStart = delay;
+        tags->trimEnd = padding;
+    }
+
+    free(text);
+}
+
+static void id3_parse_frame(MusicTags *tags, int *coverPriority, const char *id, unsigned char *data, size_t size) {
+    if(size == 0) return;
+
+    if(strcmp(id, "APIC") == 0 || strcmp(id, "PIC") == 0) {
+        id3_parse_picture(tags, coverPriority, id[3] == '\0', data, size);
+        return;
+    }
+
+    if(strcmp(id, "COMM") == 0 || strcmp(id, "COM") == 0) {
+        id3_parse_comment(tags, data, size);
+        return;
+    }
+
+    char **dst = NULL;
+    bool isGenre = false;
+
+    if(strcmp(id, "TIT2") == 0 || strcmp(id, "TT2") == 0) {
+        dst = &tags->title;
+    } else if(strcmp(id, "TPE1") == 0 || strcmp(id, "TP1") == 0) {
+        dst = &tags->artist;
+    } else if(strcmp(id, "TALB") == 0 || strcmp(id, "TAL") == 0) {
+        dst = &tags->album;
+    } else if(strcmp(id, "TCON") == 0 || strcmp(id, "TCO") == 0) {
+        dst = &tags->genre;
+        isGenre = true;
+    }
+
+    if(dst == NULL) return;
+
+    char *value = id3_decode_text(data[0], data + 1, size - 1);
+    if(isGenre) value = id3_resolve_genre(value);
+    set_tag_str(dst, value);
+}
+
+static void id3v2_parse_frames(MusicTags *tags, int version, bool unsync, unsigned char *data, size_t size) {
+    size_t frameHeaderSize = version == 2 ? 6 : 10;
+    size_t idSize = version == 2 ? 3 : 4;
+    int coverPriority = 0;
+    size_t pos = 0;
+
+    while(pos + frameHeaderSize <= size) {
+        unsigned char *header = data + pos;
+        // padding reached
+        if(header[0] == 0) break;
+
+        char id[5] = {0};
+        memcpy(id, header, idSize);
+
+        size_t frameSize;
+        unsigned char formatFlags = 0;
+
+        if(version == 2) {
+            frameSize = read_u24_be(header + 3);
+        } else if(version == 3) {
+            frameSize = read_u32_be(header + 4);
+            formatFlags = header[9];
+        } else {
+            frameSize = read_syncsafe(header + 4);
+            formatFlags = header[9];
+        }
+
+        pos += frameHeaderSize;
+        if(frameSize > size - pos) break;
+
+        unsigned char *frame = data + pos;
+        pos += frameSize;
+
+        if(version == 3) {
+            // compressed or encrypted
+            if(formatFlags & 0xC0) continue;
+            // grouping identity
+            if(formatFlags & 0x20) {
+                if(frameSize < 1) continue;
+                frame++;
+                frameSize--;
+            }
+        } else if(version == 4) {
+            // compressed or encrypted
+            if(formatFlags & 0x0C) continue;
+
+            size_t skip = 0;
+            if(formatFlags & 0x40) skip += 1; // grouping identity
+            if(formatFlags & 0x01) skip += 4; // data length indicator
+            if(skip > frameSize) continue;
+            frame += skip;
+            frameSize -= skip;
+
+            if(unsync || formatFlags & 0x02) frameSize = id3_resync(frame, frameSize);
+        }
+
+        id3_parse_frame(tags, &coverPriority, id, frame, frameSize);
+    }
+}
+
+static bool read_id3v2(FILE *fp, MusicTags *tags) {
+    unsigned char header[ID3V2_HEADER_SIZE];
+    if(fread(header, 1, sizeof(header), fp) != sizeof(header)) return false;
+    if(memcmp(header, "ID3", 3) != 0) return false;
+
+    int version = header[3];
+    if(version < 2 || version > 4) return false;
+
+    unsigned char flags = header[5];
+    size_t size = read_syncsafe(header + 6);
+
+    unsigned char *data = malloc(size);
+    if(data == NULL) return false;
+
+    if(fread(data, 1, size, fp) != size) {
+        free(data);
+        return false;
+    }
+
+    tags->data = data;
+
+    // before v2.4 the whole tag is unsynchronised at once, in v2.4 it is done per frame
+    if(flags & ID3V2_FLAG_UNSYNC && version < 4) {
+        size = id3_resync(data, size);
+    }
+
+    size_t pos = 0;
+
+    if(flags & ID3V2_FLAG_EXTENDED_HEADER && version >= 3 && size >= 4) {
+        // in v2.3 the size doesn't include itself
+        pos = version == 3 ? read_u32_be(data) + 4 : read_syncsafe(data);
+        if(pos > size) return true;
+    }
+
+    id3v2_parse_frames(tags, version, flags & ID3V2_FLAG_UNSYNC, data + pos, size - pos);
+
+    return true;
+}
+
+static char *id3v1_read_field(const unsigned char *field, size_t size) {
+    size_t length = 0;
+    while(length < size && field[length] != 0) length++;
+    while(length > 0 && field[length - 1] == ' ') length--;
+    return id3_decode_text(0, field, length);
+}
+
+static bool read_id3v1(FILE *fp, MusicTags *tags) {
+    unsigned char tag[ID3V1_SIZE];
+
+    if(fseek(fp, -ID3V1_SIZE, SEEK_END) != 0) return false;
+    if(fread(tag, 1, sizeof(tag), fp) != sizeof(tag)) return false;
+    if(memcmp(tag, "TAG", 3) != 0) return false;
+
+    set_tag_str(&tags->title, id3v1_read_field(tag + 3, 30));
+    set_tag_str(&tags->artist, id3v1_read_field(tag + 33, 30));
+    set_tag_str(&tags->album, id3v1_read_field(tag + 63, 30));
+
+    char *genre = id3_genre_name(tag[127]);
+    if(genre != NULL) set_tag_str(&tags->genre, genre);
+
+    return true;
+}
+
+// FLAC PICTURE block (big endian): picture type, mime type, description, width, height, depth, colors and data
+// the base64 METADATA_BLOCK_PICTURE of the vorbis comments has the same layout
+static void flac_parse_picture(MusicTags *tags, int *coverPriority, unsigned char *block, size_t size) {
+    size_t pos = 0;
+
+    if(size < 8) goto invalid;
+    int pictureType = read_u32_be(block);
+    size_t mimeSize = read_u32_be(block + 4);
+    pos = 8;
+
+    if(mimeSize > size - pos || size - pos - mimeSize < 4) goto invalid;
+    pos += mimeSize;
+    size_t descriptionSize = read_u32_be(block + pos);
+    pos += 4;
+
+    // description plus width, height, depth, colors and the data length
+    if(descriptionSize > size - pos || size - pos - descriptionSize < 20) goto invalid;
+    pos += descriptionSize + 16;
+    size_t dataSize = read_u32_be(block + pos);
+    pos += 4;
+
+    if(dataSize > size - pos) goto invalid;
+
+    take_tags_cover(tags, coverPriority, pictureType, block, block + pos, dataSize);
+    return;
+
+invalid:
+    free(block);
+}
+
+static char *vorbis_comment_value(const unsigned char *value, size_t size) {
+    char *str = malloc(size + 1);
+    memcpy(str, value, size);
+    str[size] = '\0';
+    return str;
+}
+
+// vorbis comment (little endian): vendor string, comments count and "KEY=value" comments
+// it's shared by the FLAC VORBIS_COMMENT block and the ogg comment header
+static void parse_vorbis_comment(MusicTags *tags, int *coverPriority, const unsigned char *data, size_t size) {
+    if(size < 4) return;
+    size_t vendorSize = read_u32_le(data);
+    size_t pos = 4;
+
+    if(vendorSize > size - pos || size - pos - vendorSize < 4) return;
+    pos += vendorSize;
+    unsigned int count = read_u32_le(data + pos);
+    pos += 4;
+
+    for(unsigned int i = 0; i < count && size - pos >= 4; i++) {
+        size_t commentSize = read_u32_le(data + pos);
+        pos += 4;
+        if(commentSize > size - pos) return;
+
+        const unsigned char *comment = data + pos;
+        pos += commentSize;
+
+        const unsigned char *equal = memchr(comment, '=', commentSize);
+        if(equal == NULL) continue;
+
+        size_t keySize = equal - comment;
+        const unsigned char *value = equal + 1;
+        size_t valueSize = commentSize - keySize - 1;
+
+        #define IS_KEY(key) (keySize == sizeof(key) - 1 && strncasecmp((const char*)comment, key, keySize) == 0)
+
+        if(IS_KEY("TITLE")) {
+            set_tag_str(&tags->title, vorbis_comment_value(value, valueSize));
+        } else if(IS_KEY("ARTIST")) {
+            set_tag_str(&tags->artist, vorbis_comment_value(value, valueSize));
+        } else if(IS_KEY("GENRE")) {
+            set_tag_str(&tags->genre, vorbis_comment_value(value, valueSize));
+        } else if(IS_KEY("ALBUM")) {
+            set_tag_str(&tags->album, vorbis_comment_value(value, valueSize));
+        } else if(IS_KEY("METADATA_BLOCK_PICTURE")) {
+            size_t blockSize;
+            unsigned char *block = base64_decode(value, valueSize, &blockSize);
+            if(block != NULL) flac_parse_picture(tags, coverPriority, block, blockSize);
+        } else if(IS_KEY("COVERART")) {
+            // legacy field with the raw image encoded in base64
+            size_t pictureSize;
+            unsigned char *picture = base64_decode(value, valueSize, &pictureSize);
+            if(picture != NULL) take_tags_cover(tags, coverPriority, ID3_PICTURE_FRONT_COVER, picture, picture, pictureSize);
+        }
+
+        #undef IS_KEY
+    }
+}
+
+// STREAMINFO: sample rate (20 bits), channels (3), bits per sample (5) and total samples (36) start at byte 10
+static void flac_parse_streaminfo(MusicTags *tags, const unsigned char *block, size_t size) {
+    if(size < 18) return;
+
+    unsigned int sampleRate = block[10] << 12 | block[11] << 4 | block[12] >> 4;
+    unsigned long long samples = (unsigned long long)(block[13] & 0x0F) << 32 | read_u32_be(block + 14);
+
+    if(sampleRate > 0) tags->duration = (double)samples / sampleRate;
+}
+
+// only the metadata blocks are read, the file position is left before the first audio frame
+static bool read_flac_tags(FILE *fp, MusicTags *tags) {
+    int coverPriority = 0;
+    bool last = false;
+
+    while(!last) {
+        unsigned char header[4];
+        if(fread(header, 1, sizeof(header), fp) != sizeof(header)) break;
+
+        last = header[0] & FLAC_BLOCK_LAST;
+        int type = header[0] & 0x7F;
+        size_t size = read_u24_be(header + 1);
+
+        if(type != FLAC_BLOCK_STREAMINFO && type != FLAC_BLOCK_VORBIS_COMMENT && type != FLAC_BLOCK_PICTURE) {
+            if(fseek(fp, size, SEEK_CUR) != 0) break;
+            continue;
+        }
+
+        unsigned char *block = malloc(size);
+        if(block == NULL) break;
+
+        if(fread(block, 1, size, fp) != size) {
+            free(block);
+            break;
+        }
+
+        if(type == FLAC_BLOCK_STREAMINFO) {
+            flac_parse_streaminfo(tags, block, size);
+            free(block);
+        } else if(type == FLAC_BLOCK_PICTURE) {
+            flac_parse_picture(tags, &coverPriority, block, size);
+        } else {
+            parse_vorbis_comment(tags, &coverPriority, block, size);
+            free(block);
+        }
+    }
+
+    return true;
+}
+
+// the granule position of the last page of the stream is its length in samples
+static bool ogg_read_last_granule(FILE *fp, unsigned int serial, unsigned long long *granule) {
+    if(fseek(fp, 0, SEEK_END) != 0) return false;
+    long fileSize = ftell(fp);
+    long start = fileSize > OGG_LAST_PAGE_SEARCH ? fileSize - OGG_LAST_PAGE_SEARCH : 0;
+
+    unsigned char *buffer = malloc(fileSize - start);
+    if(buffer == NULL) return false;
+
+    size_t count = 0;
+    if(fseek(fp, start, SEEK_SET) == 0) count = fread(buffer, 1, fileSize - start, fp);
+
+    bool found = false;
+    for(size_t i = count >= OGG_PAGE_HEADER_SIZE ? count - OGG_PAGE_HEADER_SIZE + 1 : 0; i-- > 0;) {
+        if(memcmp(buffer + i, "OggS", 4) == 0 && read_u32_le(buffer + i + 14) == serial) {
+            *granule = read_u64_le(buffer + i + 6);
+            found = true;
+            break;
+        }
+    }
+
+    free(buffer);
+    return found;
+}
+
+// vorbis: "\x01vorbis", version, channels, sample rate
+// opus: "OpusHead", version, channels, pre-skip, the granule is always at 48kHz
+static void ogg_read_duration(FILE *fp, MusicTags *tags, unsigned int serial, const unsigned char *ident, size_t size) {
+    unsigned int sampleRate = 0;
+    unsigned int preSkip = 0;
+
+    if(size >= 16 && memcmp(ident, "\x01vorbis", 7) == 0) {
+        sampleRate = read_u32_le(ident + 12);
+    } else if(size >= 12 && memcmp(ident, "OpusHead", 8) == 0) {
+        sampleRate = OPUS_SAMPLE_RATE;
+        preSkip = read_u16_le(ident + 10);
+    }
+
+    unsigned long long granule;
+    if(sampleRate == 0 || !ogg_read_last_granule(fp, serial, &granule) || granule < preSkip) return;
+
+    tags->duration = (double)(granule - preSkip) / sampleRate;
+}
+
+// reads the pages of the first logical stream until the comment header (its second packet) is complete
+// works for vorbis and opus, only the last page is read after that to know the duration
+static bool read_ogg_tags(FILE *fp, MusicTags *tags) {
+    struct {
+        unsigned char *items;
+        size_t count;
+        size_t capacity;
+    } packets[2] = {0}; // identification and comment headers
+
+    int packetIndex = 0;
+    unsigned int serial = 0;
+    bool firstPage = true;
+
+    while(packetIndex < 2) {
+        unsigned char header[OGG_PAGE_HEADER_SIZE];
+        if(fread(header, 1, sizeof(header), fp) != sizeof(header)) break;
+        if(memcmp(header, "OggS", 4) != 0) break;
+
+        unsigned int pageSerial = read_u32_le(header + 14);
+        int segmentsCount = header[26];
+
+        unsigned char lacing[255];
+        if(fread(lacing, 1, segmentsCount, fp) != (size_t)segmentsCount) break;
+
+        if(firstPage) {
+            serial = pageSerial;
+            firstPage = false;
+        }
+
+        for(int i = 0; i < segmentsCount && packetIndex < 2; i++) {
+            if(pageSerial == serial) {
+                unsigned char segment[255];
+                if(fread(segment, 1, lacing[i], fp) != lacing[i]) goto done;
+                da_append_many(&packets[packetIndex], segment, lacing[i]);
+            } else if(fseek(fp, lacing[i], SEEK_CUR) != 0) {
+                goto done;
+            }
+
+            if(pageSerial == serial && lacing[i] < 255) packetIndex++;
+        }
+    }
+
+done:
+    if(packetIndex == 2) {
+        int coverPriority = 0;
+        unsigned char *comment = packets[1].items;
+        size_t size = packets[1].count;
+
+        if(size >= 7 && memcmp(comment, "\x03vorbis", 7) == 0) {
+            parse_vorbis_comment(tags, &coverPriority, comment + 7, size - 7);
+        } else if(size >= 8 && memcmp(comment, "OpusTags", 8) == 0) {
+            parse_vorbis_comment(tags, &coverPriority, comment + 8, size - 8);
+        }
+
+        ogg_read_duration(fp, tags, serial, packets[0].items, packets[0].count);
+    }
+
+    da_free(&packets[0]);
+    da_free(&packets[1]);
+    return true;
+}
+
+// RIFF chunks: id and little endian size, the data is padded to an even size
+// "fmt " has the byte rate, "data" the samples and "LIST" with "INFO" the tags
+static bool read_wav_tags(FILE *fp, MusicTags *tags) {
+    unsigned int byteRate = 0;
+    unsigned long long dataSize = 0;
+
+    while(true) {
+        unsigned char header[8];
+        if(fread(header, 1, sizeof(header), fp) != sizeof(header)) break;
+
+        unsigned int size = read_u32_le(header + 4);
+        long next = ftell(fp) + size + (size & 1);
+
+        if(memcmp(header, "fmt ", 4) == 0 && size >= 12) {
+            unsigned char fmt[12];
+            if(fread(fmt, 1, sizeof(fmt), fp) != sizeof(fmt)) break;
+            byteRate = read_u32_le(fmt + 8);
+        } else if(memcmp(header, "data", 4) == 0) {
+            dataSize = size;
+        } else if(memcmp(header, "LIST", 4) == 0 && size >= 4) {
+            unsigned char *list = malloc(size);
+            if(list == NULL || fread(list, 1, size, fp) != size) {
+                free(list);
+                break;
+            }
+
+            for(size_t pos = 4; memcmp(list, "INFO", 4) == 0 && pos + 8 <= size;) {
+                const unsigned char *id = list + pos;
+                size_t valueSize = read_u32_le(list + pos + 4);
+                pos += 8;
+                if(valueSize > size - pos) break;
+
+                char **dst = NULL;
+                if(memcmp(id, "INAM", 4) == 0) dst = &tags->title;
+                else if(memcmp(id, "IART", 4) == 0) dst = &tags->artist;
+                else if(memcmp(id, "IGNR", 4) == 0) dst = &tags->genre;
+                else if(memcmp(id, "IPRD", 4) == 0) dst = &tags->album;
+
+                if(dst != NULL) set_tag_str(dst, id3_decode_text(3, list + pos, valueSize));
+                pos += valueSize + (valueSize & 1);
+            }
+
+            free(list);
+        }
+
+        if(fseek(fp, next, SEEK_SET) != 0) break;
+    }
+
+    if(byteRate > 0) tags->duration = (double)dataSize / byteRate;
+    return true;
+}
+
+// "qoaf", samples per channel (32 bits), then the first frame header starts with channels and sample rate
+static bool read_qoa_tags(FILE *fp, MusicTags *tags) {
+    unsigned char header[8];
+    if(fread(header, 1, sizeof(header), fp) != sizeof(header)) return true;
+
+    unsigned int samples = read_u32_be(header);
+    unsigned int sampleRate = read_u24_be(header + 5);
+    if(sampleRate > 0) tags->duration = (double)samples / sampleRate;
+
+    return true;
+}
+
+// checks for the sync word of a mpeg audio frame, used for mp3 files without ID3v2
+static bool is_mpeg_audio(FILE *fp) {
+    unsigned char header[2];
+    if(fseek(fp, 0, SEEK_SET) != 0) return false;
+    if(fread(header, 1, sizeof(header), fp) != sizeof(header)) return false;
+    return header[0] == 0xFF && (header[1] & 0xE0) == 0xE0;
+}
+
+static void fill_missing_tags(MusicTags *tags) {
+    if(tags->title == NULL) tags->title = strdup("");
+    if(tags->artist == NULL) tags->artist = strdup("");
+    if(tags->genre == NULL) tags->genre = strdup("");
+    if(tags->album == NULL) tags->album = strdup("");
+}
+
+// the frames count of the Xing/VBRI header gives the exact duration, otherwise it's estimated from the bitrate
+static void read_mp3_duration(FILE *fp, MusicTags *tags, long start) {
+    unsigned char buffer[MP3_FIRST_FRAME_SEARCH];
+    if(fseek(fp, start, SEEK_SET) != 0) return;
+    size_t count = fread(buffer, 1, sizeof(buffer), fp);
+
+    for(size_t i = 0; i + MP3_HEADER_SIZE <= count; i++) {
+        Mp3FrameHeader header;
+        Mp3FrameHeader next;
+        if(!parse_mp3_header(buffer + i, &header)) continue;
+
+        size_t nextPos = i + header.length;
+        if(nextPos + MP3_HEADER_SIZE > count || !parse_mp3_header(buffer + nextPos, &next) || !same_mp3_stream(&header, &next)) continue;
+
+        unsigned int frames;
+        if(get_mp3_vbr_frames(buffer + i, count - i, &header, &frames)) {
+            tags->duration = (double)frames * header.samples / header.sampleRate;
+
+            // the decoder adds MP3_DECODER_DELAY frames before the encoder delay, iTunSMPB already counts them
+            // dr_mp3 decodes the Xing/Info frame too (see seek.c), its silence comes first
+            unsigned int delay, padding;
+            if(tags->trimStart == 0 && get_mp3_encoder_delay(buffer + i, count - i, &header, &delay, &padding)) {
+                tags->trimStart = header.samples + delay + MP3_DECODER_DELAY;
+                tags->trimEnd = padding > MP3_DECODER_DELAY ? padding - MP3_DECODER_DELAY : 0;
+                tags->duration -= (double)(delay + padding) / header.sampleRate;
+            } else if(tags->trimStart != 0) {
+                tags->trimStart += header.samples;
+            }
+            return;
+        }
+
+        if(fseek(fp, 0, SEEK_END) != 0) return;
+        long audioSize = ftell(fp) - start - (long)i;
+
+        unsigned char tag[3];
+        if(fseek(fp, -ID3V1_SIZE, SEEK_END) == 0 && fread(tag, 1, sizeof(tag), fp) == sizeof(tag) && memcmp(tag, "TAG", 3) == 0) {
+            audioSize -= ID3V1_SIZE;
+        }
+
+        tags->duration = (double)audioSize * 8 / header.bitrate;
+        return;
+    }
+}
+
+static bool read_mp3_tags(FILE *fp, MusicTags *tags, long start) {
+    bool found = read_id3v2(fp, tags);
+
+    // ID3v1 is only used for the fields that ID3v2 didn't have
+    if(tags->title == NULL || tags->artist == NULL || tags->album == NULL || tags->genre == NULL) {
+        found |= read_id3v1(fp, tags);
+    }
+
+    if(!found) found = is_mpeg_audio(fp);
+    if(found) read_mp3_duration(fp, tags, start);
+
+    return found;
+}
+
+// returns the offset where the audio container starts, some FLAC files are prefixed with an ID3v2 tag
+static long get_container_start(FILE *fp) {
+    unsigned char header[ID3V2_HEADER_SIZE];
+    if(fread(header, 1, sizeof(header), fp) != sizeof(header)) return 0;
+    if(memcmp(header, "ID3", 3) != 0) return 0;
+
+    long start = ID3V2_HEADER_SIZE + read_syncsafe(header + 6);
+    // footer
+    if(header[5] & 0x10) start += ID3V2_HEADER_SIZE;
+    return start;
+}
+
+bool read_music_tags(const char *filePath, MusicTags *tags) {
+    memset(tags, 0, sizeof(MusicTags));
+
+    FILE *fp = fopen(filePath, "rb");
+    if(fp == NULL) return false;
+
+    unsigned char magic[4] = {0};
+    long start = get_container_start(fp);
+    bool found = false;
+
+    if(fseek(fp, start, SEEK_SET) == 0 && fread(magic, 1, sizeof(magic), fp) == sizeof(magic)) {
+        if(memcmp(magic, "fLaC", 4) == 0) {
+            found = read_flac_tags(fp, tags);
+        } else if(memcmp(magic, "OggS", 4) == 0) {
+            fseek(fp, start, SEEK_SET);
+            found = read_ogg_tags(fp, tags);
+        } else if(memcmp(magic, "qoaf", 4) == 0) {
+            found = read_qoa_tags(fp, tags);
+        } else if(memcmp(magic, "RIFF", 4) == 0) {
+            unsigned char wave[8];
+            if(fread(wave, 1, sizeof(wave), fp) == sizeof(wave) && memcmp(wave + 4, "WAVE", 4) == 0) {
+                found = read_wav_tags(fp, tags);
+            }
+        }
+    }
+
+    if(!found) {
+        fseek(fp, 0, SEEK_SET);
+        found = read_mp3_tags(fp, tags, start);
+    }
+
+    fclose(fp);
+
+    if(!found) {
+        unload_music_tags(tags);
+        return false;
+    }
+
+    fill_missing_tags(tags);
+    return true;
+}
+
+void unload_music_tags(MusicTags *tags) {
+    free(tags->title);
+    free(tags->artist);
+    free(tags->genre);
+    free(tags->album);
+    free(tags->data);
+    memset(tags, 0, sizeof(MusicTags));
+}
@@ -0,0 +1,42 @@
+#ifndef TAGS_H
+#define TAGS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    // null terminated utf-8 strings, empty when the tag is not present
+    char *title;
+    char *artist;
+    char *genre;
+    char *album;
+
+    float duration; // seconds, 0 when it couldn't be read from the headers
+
+    // embedded picture, it points inside `data` so it can be passed directly to LoadImageFromMemory
+    const unsigned char *cover;
+    int coverSize;
+    const char *coverType; // file extension of the picture (".jpg", ".png")
+
+    // pcm frames of encoder delay and padding to drop at the start and the end of the decoded mp3, from the
+    // LAME header or the iTunSMPB comment, 0 for the other formats
+    unsigned int trimStart;
+    unsigned int trimEnd;
+
+    unsigned char *data; // raw tag bytes
+} MusicTags;
+
+// reads the tags of a mp3 (ID3v2/ID3v1), flac, ogg (vorbis/opus), wav (LIST INFO) or qoa file without spawning any process
+// returns false when the file format is not supported, in that case nothing is allocated
+bool read_music_tags(const char *filePath, MusicTags *tags);
+
+// returns the extension of the picture based on its magic bytes, NULL if the format is unknown
+const char *get_picture_file_type(const unsigned char *data, size_t size);
+
+// reads the width and height from the header of the picture without decoding it
+bool get_picture_size(const unsigned char *data, size_t size, int *width, int *height);
+
+// frees everything owned by the tags, the strings moved out of it have to be set to NULL before
+void unload_music_tags(MusicTags *tags);
+
+#endif // TAGS_H
@@ -0,0 +1,94 @@
+#include <stdbool.h>
+
+#include "text.h"
+
+// U+00C0 to U+017F (Latin-1 Supplement and Latin Extended-A) without accents and lowercase
+static const char *latinFolds[] = {
+    "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",
+    "d", "n", "o", "o", "o", "o", "o", " ", "o", "u", "u", "u", "u", "y", "th", "ss",
+    "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",
+    "d", "n", "o", "o", "o", "o", "o", " ", "o", "u", "u", "u", "u", "y", "th", "y",
+    "a", "a", "a", "a", "a", "a", "c", "c", "c", "c", "c", "c", "c", "c", "d", "d",
+    "d", "d", "e", "e", "e", "e", "e", "e", "e", "e", "e", "e", "g", "g", "g", "g",
+    "g", "g", "g", "g", "h", "h", "h", "h", "i", "i", "i", "i", "i", "i", "i", "i",
+    "i", "i", "ij", "ij", "j", "j", "k", "k", "k", "l", "l", "l", "l", "l", "l", "l",
+    "l", "l", "l", "n", "n", "n", "n", "n", "n", "n", "n", "n", "o", "o", "o", "o",
+    "o", "o", "oe", "oe", "r", "r", "r", "r", "r", "r", "s", "s", "s", "s", "s", "s",
+    "s", "s", "t", "t", "t", "t", "t", "t", "u", "u", "u", "u", "u", "u", "u", "u",
+    "u", "u", "u", "u", "w", "w", "y", "y", "y", "z", "z", "z", "z", "z", "z", "s",
+};
+
+// greek letters with tonos or dialytika from U+0386 to U+03CE, 0 for the ones without accent
+static const unsigned short greekFolds[] = {
+    0x03B1, 0, 0x03B5, 0x03B7, 0x03B9, 0, 0x03BF, 0, 0x03C5, 0x03C9, 0x03B9, // U+0386 - U+0390
+    [0x03AA - 0x0386] = 0x03B9, 0x03C5, 0x03B1, 0x03B5, 0x03B7, 0x03B9, 0x03C5, // U+03AA - U+03B0
+    [0x03CA - 0x0386] = 0x03B9, 0x03C5, 0x03BF, 0x03C5, 0x03C9, // U+03CA - U+03CE
+};
+
+unsigned int next_codepoint(const char **str) {
+    const unsigned char *p = (const unsigned char*)*str;
+    unsigned int codepoint = p[0];
+    int length = 1;
+
+    if(p[0] >= 0xC0 && p[0] < 0xE0 && (p[1] & 0xC0) == 0x80) {
+        codepoint = (p[0] & 0x1F) << 6 | (p[1] & 0x3F);
+        length = 2;
+    } else if(p[0] >= 0xE0 && p[0] < 0xF0 && (p[1] & 0xC0) == 0x80 && (p[2] & 0xC0) == 0x80) {
+        codepoint = (p[0] & 0x0F) << 12 | (p[1] & 0x3F) << 6 | (p[2] & 0x3F);
+        length = 3;
+    } else if(p[0] >= 0xF0 && (p[1] & 0xC0) == 0x80 && (p[2] & 0xC0) == 0x80 && (p[3] & 0xC0) == 0x80) {
+        codepoint = (p[0] & 0x07) << 18 | (p[1] & 0x3F) << 12 | (p[2] & 0x3F) << 6 | (p[3] & 0x3F);
+        length = 4;
+    }
+
+    *str += length;
+    return codepoint;
+}
+
+static unsigned int fold_codepoint(unsigned int c) {
+    if(c >= 'A' && c <= 'Z') return c + 32;
+
+    // greek
+    if(c >= 0x0386 && c <= 0x03CE && greekFolds[c - 0x0386] != 0) return greekFolds[c - 0x0386];
+    if(c >= 0x0391 && c <= 0x03A9) return c + 32;
+    if(c == 0x03C2) return 0x03C3; // final sigma
+
+    // cyrillic
+    if(c >= 0x0410 && c <= 0x042F) return c + 32;
+    if(c >= 0x0400 && c <= 0x040F) c += 80;
+    if(c == 0x0451) return 0x0435; // ё is usually written as е
+
+    return c;
+}
+
+static bool is_separator(unsigned int c) {
+    if(c < 0x80) return !((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'));
+    // latin-1 punctuation and the general punctuation block
+    return (c >= 0x80 && c <= 0xBF) || c == 0xD7 || c == 0xF7 || (c >= 0x2000 && c <= 0x206F) || c == 0x3000;
+}
+
+void fold_text(StringBuilder *sb, const char *str) {
+    size_t start = sb->count;
+    bool space = true; // no space at the start
+
+    while(*str != '\0') {
+        unsigned int c = next_codepoint(&str);
+
+        if(is_separator(c)) {
+            if(!space) da_append(sb, ' ');
+            space = true;
+            continue;
+        }
+
+        if(c >= 0xC0 && c <= 0x17F) {
+            const char *fold = latinFolds[c - 0xC0];
+            da_append_many(sb, fold, strlen(fold));
+        } else {
+            sb_append_utf8(sb, fold_codepoint(c));
+        }
+
+        space = false;
+    }
+
+    if(sb->count > start && sb->items[sb->count - 1] == ' ') sb->count--;
+}
@@ -0,0 +1,16 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+#include "CCFuncs.h"
+
+// Folding used to compare what the user types with the tags: lowercase, without accents (latin, greek
+// and cyrillic) and with every run of punctuation or spaces turned into a single space.
+// "Beyoncé - Déjà Vu" and "beyonce deja vu" give the same text.
+
+// appends the folded text without a terminating null, there's no space at the start or at the end
+void fold_text(StringBuilder *sb, const char *str);
+
+// returns the codepoint at *str and advances it, invalid bytes are returned as they are
+unsigned int next_codepoint(const char **str);
+
+#endif // TEXT_H
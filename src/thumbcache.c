@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "CCFuncs.h"
+#include "thumbcache.h"
+#include "snapshot.h"
+
+#define THUMB_CACHE_MAGIC "CMUSICTH"
+#define THUMB_CACHE_DIR "thumbs"
+#define THUMB_CACHE_MAX_SIZE 4096 // larger headers are broken files
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t reserved;
+} ThumbHeader;
+
+static struct {
+    char *dir; // NULL when there's no cache directory, only written by thumb_cache_init
+} thumbCache;
+
+void thumb_cache_init(void) {
+    char *cacheDir = get_cache_dir();
+    if(cacheDir == NULL) return;
+
+    char dir[4096];
+    snprintf(dir, sizeof(dir), "%s/%s", cacheDir, THUMB_CACHE_DIR);
+    free(cacheDir);
+
+    mkdir(dir, 0755);
+    thumbCache.dir = strdup(dir);
+}
+
+void thumb_cache_close(void) {
+    free(thumbCache.dir);
+    thumbCache.dir = NULL;
+}
+
+static void get_thumb_path(char *path, size_t pathSize, uint32_t coverHash, int size) {
+    snprintf(path, pathSize, "%s/%08x-%d.rgba", thumbCache.dir, coverHash, size);
+}
+
+bool thumb_cache_load(uint32_t coverHash, int size, Image *image) {
+    if(thumbCache.dir == NULL || coverHash == 0) return false;
+
+    char path[4200];
+    get_thumb_path(path, sizeof(path), coverHash, size);
+
+    FILE *fp = fopen(path, "rb");
+    if(fp == NULL) return false;
+
+    ThumbHeader header;
+    bool valid = fread(&header, sizeof(header), 1, fp) == 1
+        && memcmp(header.magic, THUMB_CACHE_MAGIC, sizeof(header.magic)) == 0
+        && header.version == THUMB_CACHE_VERSION
+        && header.width > 0 && header.width <= THUMB_CACHE_MAX_SIZE
+        && header.height > 0 && header.height <= THUMB_CACHE_MAX_SIZE;
+
+    void *pixels = NULL;
+    size_t pixelsSize = (size_t)header.width * header.height * 4;
+
+    if(valid) {
+        pixels = malloc(pixelsSize);
+        valid = fread(pixels, 1, pixelsSize, fp) == pixelsSize;
+    }
+
+    fclose(fp);
+
+    if(!valid) {
+        log_error("Ignoring the broken thumbnail %s", path);
+        free(pixels);
+        unlink(path);
+        return false;
+    }
+
+    *image = (Image){
+        .data = pixels,
+        .width = header.width,
+        .height = header.height,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+    };
+    return true;
+}
+
+// writes to a temporary file so a reader never sees half of it
+static void store_thumb(uint32_t coverHash, int size, Image image) {
+    if(thumbCache.dir == NULL) return;
+
+    char path[4200];
+    char tmpPath[4300];
+    get_thumb_path(path, sizeof(path), coverHash, size);
+    // the loader and the covers threads can write the same thumbnail
+    snprintf(tmpPath, sizeof(tmpPath), "%s.%lx.tmp", path, (unsigned long)pthread_self());
+
+    FILE *fp = fopen(tmpPath, "wb");
+    if(fp == NULL) {
+        log_error("Failed to write the thumbnail %s", path);
+        return;
+    }
+
+    ThumbHeader header = {
+        .version = THUMB_CACHE_VERSION,
+        .width = image.width,
+        .height = image.height,
+    };
+    memcpy(header.magic, THUMB_CACHE_MAGIC, sizeof(header.magic));
+
+    size_t pixelsSize = (size_t)image.width * image.height * 4;
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(image.data, 1, pixelsSize, fp) == pixelsSize;
+    ok = fclose(fp) == 0 && ok;
+    ok = ok && rename(tmpPath, path) == 0;
+
+    if(!ok) {
+        log_error("Failed to write the thumbnail %s", path);
+        unlink(tmpPath);
+    }
+}
+
+Image make_cover_thumb(uint32_t coverHash, int size, const MusicTags *tags) {
+    if(tags->cover == NULL) return (Image){0};
+
+    int sourceWidth, sourceHeight;
+    bool known = get_picture_size(tags->cover, tags->coverSize, &sourceWidth, &sourceHeight);
+    if(known && (sourceWidth > COVER_MAX_SOURCE_SIZE || sourceHeight > COVER_MAX_SOURCE_SIZE)) {
+        log_error("Ignoring a cover of %dx%d pixels", sourceWidth, sourceHeight);
+        return (Image){0};
+    }
+
+    Image image = LoadImageFromMemory(tags->coverType, tags->cover, tags->coverSize);
+    if(!IsImageValid(image)) return (Image){0};
+
+    int longest = image.width > image.height ? image.width : image.height;
+    if(longest > size) {
+        int width = image.width * size / longest;
+        int height = image.height * size / longest;
+        ImageResize(&image, width < 1 ? 1 : width, height < 1 ? 1 : height);
+    }
+
+    // the format of the cache files
+    ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+
+    if(coverHash == 0) coverHash = ComputeCRC32((unsigned char*)tags->cover, tags->coverSize);
+    store_thumb(coverHash, size, image);
+
+    return image;
+}
@@ -0,0 +1,34 @@
+#ifndef THUMBCACHE_H
+#define THUMBCACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "raylib.h"
+#include "tags.h"
+
+// Disk cache of the covers scaled to the sizes the interface draws them at, so the browser grid and the
+// player view come up without decoding the pictures again, some of them are 3000 pixels wide. A file is
+// named after the crc32 of the picture bytes (the library coverHash) and the size, and holds the raw
+// RGBA pixels so loading it is a single read.
+//
+// <cache dir>/thumbs/<hash>-<size>.rgba: header | width * height * 4 bytes
+
+#define THUMB_CACHE_VERSION 1
+// pictures with a longer side are not decoded, a 16384 pixels wide one would take 1 GB
+#define COVER_MAX_SOURCE_SIZE 4096
+
+// finds the cache directory, it has to be called before the threads that use the cache are started
+void thumb_cache_init(void);
+void thumb_cache_close(void);
+
+// returns false when the thumbnail isn't in the cache or the file is broken
+bool thumb_cache_load(uint32_t coverHash, int size, Image *image);
+
+// decodes the picture of the tags and scales it down so its longest side is at most size, the result is
+// stored in the cache, the image is invalid when there's no picture, it couldn't be decoded or it's
+// larger than COVER_MAX_SOURCE_SIZE
+// a coverHash of 0 is computed from the picture
+Image make_cover_thumb(uint32_t coverHash, int size, const MusicTags *tags);
+
+#endif // THUMBCACHE_H
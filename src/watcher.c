@@ -0,0 +1,364 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "CCFuncs.h"
+#include "watcher.h"
+#include "library.h"
+
+// the changes are applied once no event arrived for this long
+#define WATCHER_DEBOUNCE_MS 500
+// but a copy that never stops doesn't delay them more than this
+#define WATCHER_MAX_DELAY_MS 5000
+
+#define WATCHER_DIR_EVENTS (IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_DELETE_SELF | IN_ONLYDIR)
+#define WATCHER_FILE_EVENTS (IN_CLOSE_WRITE | IN_MODIFY)
+#define WATCHER_EVENTS (WATCHER_DIR_EVENTS | WATCHER_FILE_EVENTS)
+
+typedef enum {
+    CHANGE_FILE, // created or modified, its tags are read again
+    CHANGE_DIR, // created or moved in, it's watched and scanned
+    CHANGE_REMOVED, // deleted or moved out, file or directory
+} ChangeKind;
+
+typedef struct {
+    char *path;
+    ChangeKind kind;
+} Change;
+
+typedef struct {
+    char **items;
+    size_t count;
+    size_t capacity;
+} PathList;
+
+static struct {
+    pthread_t thread;
+    pthread_mutex_t lock; // protects roots
+    bool running;
+    int fd;
+    int wakeFds[2]; // written to wake up the thread, for new roots or to quit
+    bool quit;
+
+    PathList roots; // directories waiting to be watched
+    PathList watchedRoots; // only used by the thread
+
+    // indexed by the watch descriptor, the kernel gives them in increasing order starting at 1
+    PathList watches;
+
+    struct {
+        Change *items;
+        size_t count;
+        size_t capacity;
+    } changes;
+    double firstChange;
+    double lastChange;
+} watcher = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .fd = -1,
+    .wakeFds = {-1, -1},
+};
+
+static double get_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static char *join_path(const char *dir, const char *name) {
+    StringBuilder sb = {0};
+    da_append_many(&sb, dir, strlen(dir));
+    if(sb.count == 0 || sb.items[sb.count - 1] != '/') da_append(&sb, '/');
+    da_append_many(&sb, name, strlen(name));
+    char *path = sb_dump_str(&sb);
+    da_free(&sb);
+    return path;
+}
+
+static void add_watch(const char *dirPath) {
+    int wd = inotify_add_watch(watcher.fd, dirPath, WATCHER_EVENTS);
+
+    if(wd < 0) {
+        // usually fs.inotify.max_user_watches is too low for the library
+        log_error("Failed to watch %s", dirPath);
+        return;
+    }
+
+    while(watcher.watches.count <= (size_t)wd) da_append(&watcher.watches, NULL);
+    free(watcher.watches.items[wd]);
+    watcher.watches.items[wd] = strdup(dirPath);
+}
+
+// the directories are walked like the library does, hidden ones and symlinks are skipped
+static void add_watches(const char *rootPath) {
+    PathList dirs = {0};
+    da_append(&dirs, strdup(rootPath));
+
+    while(dirs.count > 0) {
+        char *dirPath = dirs.items[--dirs.count];
+        add_watch(dirPath);
+
+        DIR *dir = opendir(dirPath);
+        struct dirent *entry;
+
+        while(dir != NULL && (entry = readdir(dir)) != NULL) {
+            if(entry->d_name[0] == '.') continue;
+
+            char *path = join_path(dirPath, entry->d_name);
+            struct stat st;
+            bool isDir = entry->d_type == DT_DIR || (entry->d_type == DT_UNKNOWN && lstat(path, &st) == 0 && S_ISDIR(st.st_mode));
+
+            if(isDir) {
+                da_append(&dirs, path);
+            } else {
+                free(path);
+            }
+        }
+
+        if(dir != NULL) closedir(dir);
+        free(dirPath);
+    }
+
+    da_free(&dirs);
+}
+
+// stops watching the directories that were removed or moved out, the kernel only drops the watches of deleted ones
+static void remove_watches(const char *path) {
+    size_t length = strlen(path);
+
+    for(size_t wd = 0; wd < watcher.watches.count; wd++) {
+        char *dirPath = watcher.watches.items[wd];
+        if(dirPath == NULL || strncmp(dirPath, path, length) != 0) continue;
+        if(dirPath[length] != '\0' && dirPath[length] != '/') continue;
+
+        inotify_rm_watch(watcher.fd, wd);
+        free(dirPath);
+        watcher.watches.items[wd] = NULL;
+    }
+}
+
+// a newer change of the same path replaces the old one, a file written many times is read once
+static void push_change(char *path, ChangeKind kind) {
+    double now = get_ms();
+    if(watcher.changes.count == 0) watcher.firstChange = now;
+    watcher.lastChange = now;
+
+    for(size_t i = watcher.changes.count; i-- > 0;) {
+        Change *change = &watcher.changes.items[i];
+        if(strcmp(change->path, path) != 0) continue;
+
+        free(change->path);
+        watcher.changes.count--;
+        memmove(change, change + 1, (watcher.changes.count - i) * sizeof(Change));
+        break;
+    }
+
+    da_append(&watcher.changes, ((Change){path, kind}));
+}
+
+static void handle_event(const struct inotify_event *event) {
+    if(event->mask & IN_IGNORED) {
+        // the watch was removed by the kernel or by remove_watches
+        if((size_t)event->wd < watcher.watches.count) {
+            free(watcher.watches.items[event->wd]);
+            watcher.watches.items[event->wd] = NULL;
+        }
+        return;
+    }
+
+    if(event->mask & IN_Q_OVERFLOW) {
+        log_error("The inotify queue overflowed, %s", "rescanning every root");
+        for(size_t i = 0; i < watcher.watchedRoots.count; i++) library_scan(watcher.watchedRoots.items[i]);
+        return;
+    }
+
+    if((size_t)event->wd >= watcher.watches.count || watcher.watches.items[event->wd] == NULL) return;
+    if(event->len == 0 || event->name[0] == '.') return;
+
+    char *path = join_path(watcher.watches.items[event->wd], event->name);
+    bool isDir = event->mask & IN_ISDIR;
+
+    if(event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        if(isDir) remove_watches(path);
+        push_change(path, CHANGE_REMOVED);
+    } else if(isDir && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+        // watched right away so the files copied inside it aren't missed
+        add_watches(path);
+        push_change(path, CHANGE_DIR);
+    } else if(!isDir && is_music_file(path) && (event->mask & (IN_CREATE | IN_MOVED_TO | WATCHER_FILE_EVENTS))) {
+        push_change(path, CHANGE_FILE);
+    } else {
+        free(path);
+    }
+}
+
+// the library workers read the files, the watcher thread only waits if their queue is full
+static void apply_changes(void) {
+    for(size_t i = 0; i < watcher.changes.count; i++) {
+        Change *change = &watcher.changes.items[i];
+
+        switch(change->kind) {
+            case CHANGE_FILE: library_scan_file(change->path); break;
+            case CHANGE_DIR: library_scan(change->path); break;
+            case CHANGE_REMOVED: library_remove(change->path); break;
+        }
+
+        free(change->path);
+    }
+
+    watcher.changes.count = 0;
+}
+
+static void read_events(void) {
+    // aligned like the kernel structure, a single read can return many events
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    while(true) {
+        ssize_t size = read(watcher.fd, buffer, sizeof(buffer));
+        if(size <= 0) break;
+
+        for(char *ptr = buffer; ptr < buffer + size;) {
+            const struct inotify_event *event = (const struct inotify_event*)ptr;
+            handle_event(event);
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+static void *watcher_worker(void *arg) {
+    (void)arg;
+
+    while(true) {
+        pthread_mutex_lock(&watcher.lock);
+        bool quit = watcher.quit;
+        PathList roots = watcher.roots;
+        memset(&watcher.roots, 0, sizeof(watcher.roots));
+        pthread_mutex_unlock(&watcher.lock);
+
+        for(size_t i = 0; i < roots.count; i++) {
+            add_watches(roots.items[i]);
+            da_append(&watcher.watchedRoots, roots.items[i]);
+        }
+        da_free(&roots);
+
+        if(quit) break;
+
+        int timeout = -1;
+        if(watcher.changes.count > 0) {
+            double now = get_ms();
+            double debounce = watcher.lastChange + WATCHER_DEBOUNCE_MS - now;
+            double maxDelay = watcher.firstChange + WATCHER_MAX_DELAY_MS - now;
+            double wait = debounce < maxDelay ? debounce : maxDelay;
+
+            if(wait <= 0) {
+                apply_changes();
+                continue;
+            }
+
+            timeout = (int)wait + 1;
+        }
+
+        struct pollfd fds[2] = {
+            {.fd = watcher.fd, .events = POLLIN},
+            {.fd = watcher.wakeFds[0], .events = POLLIN},
+        };
+
+        if(poll(fds, 2, timeout) < 0) continue;
+
+        if(fds[1].revents & POLLIN) {
+            char wake[64];
+            while(read(watcher.wakeFds[0], wake, sizeof(wake)) > 0);
+        }
+
+        if(fds[0].revents & POLLIN) read_events();
+    }
+
+    return NULL;
+}
+
+static void wake_watcher(void) {
+    char wake = 1;
+    if(write(watcher.wakeFds[1], &wake, 1) < 0) {
+        // the pipe is full, the thread is going to wake up anyway
+    }
+}
+
+void watcher_init(void) {
+    watcher.quit = false;
+
+    watcher.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(watcher.fd < 0) {
+        log_error("Failed to start inotify (%s)", "inotify_init1");
+        return;
+    }
+
+    if(pipe(watcher.wakeFds) != 0) {
+        log_error("Failed to create the watcher pipe (%s)", "pipe");
+        close(watcher.fd);
+        watcher.fd = -1;
+        return;
+    }
+
+    for(int i = 0; i < 2; i++) {
+        fcntl(watcher.wakeFds[i], F_SETFL, O_NONBLOCK);
+        fcntl(watcher.wakeFds[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    if(pthread_create(&watcher.thread, NULL, watcher_worker, NULL) != 0) {
+        log_error("Failed to start the watcher thread (%s)", "pthread_create");
+        close(watcher.fd);
+        close(watcher.wakeFds[0]);
+        close(watcher.wakeFds[1]);
+        watcher.fd = watcher.wakeFds[0] = watcher.wakeFds[1] = -1;
+        return;
+    }
+
+    watcher.running = true;
+}
+
+void watcher_close(void) {
+    if(!watcher.running) return;
+
+    pthread_mutex_lock(&watcher.lock);
+    watcher.quit = true;
+    pthread_mutex_unlock(&watcher.lock);
+    wake_watcher();
+
+    pthread_join(watcher.thread, NULL);
+    watcher.running = false;
+
+    close(watcher.fd);
+    close(watcher.wakeFds[0]);
+    close(watcher.wakeFds[1]);
+    watcher.fd = watcher.wakeFds[0] = watcher.wakeFds[1] = -1;
+
+    for(size_t i = 0; i < watcher.roots.count; i++) free(watcher.roots.items[i]);
+    for(size_t i = 0; i < watcher.watchedRoots.count; i++) free(watcher.watchedRoots.items[i]);
+    for(size_t i = 0; i < watcher.watches.count; i++) free(watcher.watches.items[i]);
+    for(size_t i = 0; i < watcher.changes.count; i++) free(watcher.changes.items[i].path);
+    da_free(&watcher.roots);
+    da_free(&watcher.watchedRoots);
+    da_free(&watcher.watches);
+    da_free(&watcher.changes);
+    memset(&watcher.roots, 0, sizeof(watcher.roots));
+    memset(&watcher.watchedRoots, 0, sizeof(watcher.watchedRoots));
+    memset(&watcher.watches, 0, sizeof(watcher.watches));
+    memset(&watcher.changes, 0, sizeof(watcher.changes));
+}
+
+void watcher_add_root(const char *rootPath) {
+    if(!watcher.running) return;
+
+    pthread_mutex_lock(&watcher.lock);
+    da_append(&watcher.roots, strdup(rootPath));
+    pthread_mutex_unlock(&watcher.lock);
+    wake_watcher();
+}
@@ -0,0 +1,14 @@
+#ifndef WATCHER_H
+#define WATCHER_H
+
+// Keeps the library in sync with the disk using inotify. The events are collected until the directories
+// are quiet for a moment (an album being copied sends thousands of them) and then only the files that
+// changed are read again by the library workers.
+
+void watcher_init(void);
+void watcher_close(void);
+
+// watches the directory and every directory inside it, the watches are added by the watcher thread
+void watcher_add_root(const char *rootPath);
+
+#endif // WATCHER_H